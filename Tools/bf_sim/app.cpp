@@ -36,11 +36,13 @@ namespace p95
 		m_frameBufWidth(0),
 		m_frameBufHeight(0)
 	{
+		m_simConfig.engine = bf::Engine::STEPPING;
 		m_simConfig.intructionsPerSec = 5;
 		m_simConfig.maxDataMemorySize = 32;
 
 		m_machine = new bf::BF_Machine();
 		m_machine->init(&m_simConfig);
+		m_machine->setOutputSink(&m_stdOutSink);
 
 		// "HELLO WORLD!" source
 		m_machine->m_sourceBuffer = "++++++++++[>+++++++>++++++++++>+++>+<<<<-]>++.>+.+++++++..+++.>++.\n<<+++++++++++++++.>.+++.------.--------.>+.>.";
@@ -369,16 +371,20 @@ namespace p95
 			if(m_simConfig.intructionsPerSec < 1) m_simConfig.intructionsPerSec = 1;
 			if(m_simConfig.intructionsPerSec > bf::SimConfig::MAX_INSTR_PER_SEC) m_simConfig.intructionsPerSec = bf::SimConfig::MAX_INSTR_PER_SEC;
 
+			static bool _sourceRejected = false;
+
 			/* Load BF source */
 			imgui::SeparatorText("Simulation");
 			imgui::Spacing();
 			if(imgui::Button("LOAD SOURCE"))
 			{
 				if(m_machine->getState() == bf::MachineState::READY)
-					m_machine->parseSource(m_machine->m_sourceBuffer);
+					_sourceRejected = !m_machine->parseSource(m_machine->m_sourceBuffer);
 			}
 			imgui::SameLine();
 			imgui::Text("  Program length: %d B", m_machine->getProgMemoSize());
+			if(_sourceRejected)
+				imgui::TextColored(ImVec4(COLOR_CELL_FRAME), "Unbalanced brackets, source not loaded");
 			imgui::NewLine();
 
 			/* Step */
@@ -418,9 +424,13 @@ namespace p95
 						auto _timeNow = std::chrono::steady_clock::now();
 						float _elapsed = std::chrono::duration<float, std::milli>(_timeNow - startTime).count();
 
-						if(_elapsed >= 1000 / m_simConfig.intructionsPerSec)
+						/* Catch up on every tick due since the last one, frames can be slower than the step rate */
+						size_t _due = (size_t)(_elapsed * m_simConfig.intructionsPerSec / 1000);
+						if(_due > (size_t)m_simConfig.intructionsPerSec)
+							_due = m_simConfig.intructionsPerSec; // Don't burst after a pause
+						if(_due > 0)
 						{
-							m_machine->tick();
+							m_machine->runFor(_due);
 							startTime = _timeNow;
 						}
 					}
@@ -461,6 +471,7 @@ namespace p95
 			imgui::Text("DP: 0x%02X", m_machine->getDataPtr());
 			imgui::Text("IP: 0x%02X", m_machine->getInstructionPtr());
 			imgui::Text("Current instruction: %c (0x%02X)", m_machine->getCurrentInstruction(), m_machine->getCurrentInstruction());
+			imgui::Text("Engine: %s (%u IR ops)", bf::engineToStr(m_machine->getEngine()), m_machine->getIRSize());
 			imgui::Text("Data memory size limit: %u B", m_machine->getDataMemoCapacity());
 			
 			{
@@ -471,12 +482,11 @@ namespace p95
 				imgui::TextUnformatted("STD IN:");
 				imgui::SameLine();
 
-				//static char _tmp_stdinBuf[m_machine->MAX_STD_IN_SIZE + 1] = { 0 };
-				if(m_machine->getStdInSize() <= m_machine->MAX_STD_IN_SIZE)
+				/* Shows pending input, edits replace it */
 				{
-					static std::string _stdIn = m_machine->getStdIn();
-					imgui::InputText("##input_stdin", &_stdIn);
-					m_machine->writeToStdInBuffer(_stdIn);
+					std::string _stdIn = m_machine->getStdIn();
+					if(imgui::InputText("##input_stdin", &_stdIn))
+						m_machine->writeToStdInBuffer(_stdIn);
 				}
 
 				imgui::Text("Buffer size: %u B", m_machine->getStdInSize());
@@ -486,18 +496,19 @@ namespace p95
 				imgui::TextUnformatted("STD OUT:");
 				imgui::SameLine();
 
-				static std::string _stdOut = m_machine->getStdOut();
+				/* Everything the program printed so far, the machine's buffer is flushed into the sink every frame */
+				m_machine->flushStdOut();
+				std::string _stdOut = m_stdOutSink.getData();
 				imgui::PushStyleColor(ImGuiCol_FrameBg, IM_COL32(45, 45, 45, 255));
-				//imgui::InputText("##input_stdout", (char*)m_machine->getStdOut().c_str(), m_machine->MAX_STD_OUT_SIZE + 1, ImGuiInputTextFlags_ReadOnly);
 				imgui::InputText("##input_stdout", &_stdOut, ImGuiInputTextFlags_ReadOnly);
 				imgui::PopStyleColor();
-				imgui::Text("Buffer size: %u B", m_machine->getStdOutSize());
+				imgui::Text("Output size: %u B", m_stdOutSink.getData().size());
 
 				imgui::NewLine();
 				if(imgui::Button("Clear IO buffers"))
 				{
 					m_machine->clearIOBuffers();
-					//sprintf_s(_tmp_stdinBuf, "");
+					m_stdOutSink.clear();
 				}
 			}			
 		}
@@ -519,6 +530,20 @@ namespace p95
 
 			imgui::Spacing();
 
+			imgui::TextUnformatted("Execution engine (applied on load)");
+			imgui::SetNextItemWidth(100.f);
+			if(imgui::BeginCombo("##engine", bf::engineToStr(m_simConfig.engine)))
+			{
+				for(bf::Engine _engine : { bf::Engine::STEPPING, bf::Engine::IR, bf::Engine::THREADED, bf::Engine::JIT, bf::Engine::NATIVE, bf::Engine::TIERED })
+				{
+					if(imgui::Selectable(bf::engineToStr(_engine), m_simConfig.engine == _engine))
+						m_simConfig.engine = _engine;
+				}
+				imgui::EndCombo();
+			}
+
+			imgui::Spacing();
+
 			imgui::TextUnformatted("Data memory limit");
 			imgui::SetNextItemWidth(100.f);
 			imgui::InputInt("##", &m_simConfig.maxDataMemorySize, 32, 512);
@@ -526,9 +551,7 @@ namespace p95
 
 			imgui::NewLine(); imgui::NewLine();
 			if(imgui::Button("Apply"))
-			{
-
-			}
+				m_machine->resizeDataMemory();
 		}
 
 		// FOOTER
@@ -50,6 +50,7 @@ namespace p95
 
 		bf::SimConfig m_simConfig;
 		bf::BF_Machine* m_machine;
+		bf::MemorySink m_stdOutSink;
 
 	};
 }
\ No newline at end of file
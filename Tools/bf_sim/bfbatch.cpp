@@ -0,0 +1,209 @@
+#include "bfbatch.h"
+
+#include <string.h>
+
+#include <mutex>
+#include <thread>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		namespace
+		{
+			/* Reads a shared input in place, no copy per job */
+			class SharedSource : public InputSource
+			{
+			public:
+
+				explicit SharedSource(const std::string* data) :
+					m_data(data),
+					m_pos(0)
+				{
+				}
+
+				long read(char* buffer, size_t size) override
+				{
+					if(!m_data || m_pos >= m_data->size())
+						return END;
+
+					size_t _n = m_data->size() - m_pos;
+					if(_n > size)
+						_n = size;
+					memcpy(buffer, m_data->data() + m_pos, _n);
+					m_pos += _n;
+					return (long)_n;
+				}
+
+			private:
+
+				const std::string* m_data;
+				size_t m_pos;
+			};
+
+			/* Appends straight to the job's result */
+			class ResultSink : public OutputSink
+			{
+			public:
+
+				explicit ResultSink(std::string& output) :
+					m_output(output)
+				{
+				}
+
+				size_t write(const char* data, size_t size) override
+				{
+					m_output.append(data, size);
+					return size;
+				}
+
+			private:
+
+				std::string& m_output;
+			};
+		}
+
+		/* Own block of jobs [begin, end). The owner takes from the front, thieves from the back.
+		* Padded to a cache line so workers don't contend on each other's ranges. */
+		struct alignas(64) BatchRunner::Worker
+		{
+			std::mutex lock;
+			size_t begin = 0;
+			size_t end = 0;
+			BF_Machine machine;
+		};
+
+		BatchRunner::BatchRunner(int tapeSize, unsigned int threads, bool guardedTape)
+		{
+			if(threads == 0)
+				threads = std::thread::hardware_concurrency();
+			if(threads == 0)
+				threads = 1;
+
+			m_config = {};
+			m_config.engine = Engine::THREADED;
+			m_config.maxDataMemorySize = tapeSize;
+			m_config.guardedTape = guardedTape;
+
+			m_threadCount = threads;
+			m_workers.reset(new Worker[threads]);
+			for(unsigned int i = 0; i < threads; i++)
+				m_workers[i].machine.init(&m_config);
+		}
+
+		BatchRunner::~BatchRunner() = default;
+
+		size_t BatchRunner::submit(BatchJob job)
+		{
+			m_jobs.push_back(std::move(job));
+			return m_jobs.size() - 1;
+		}
+
+		std::vector<BatchResult> BatchRunner::run()
+		{
+			std::vector<BatchResult> _results(m_jobs.size());
+			if(m_jobs.empty())
+				return _results;
+
+			/* No more workers than jobs, the rest would only spin looking for something to steal */
+			unsigned int _threads = m_threadCount;
+			if(_threads > m_jobs.size())
+				_threads = (unsigned int)m_jobs.size();
+
+			for(unsigned int i = 0; i < _threads; i++)
+			{
+				m_workers[i].begin = m_jobs.size() * i / _threads;
+				m_workers[i].end = m_jobs.size() * (i + 1) / _threads;
+			}
+			for(unsigned int i = _threads; i < m_threadCount; i++)
+				m_workers[i].begin = m_workers[i].end = 0;
+
+			std::vector<std::thread> _pool;
+			_pool.reserve(_threads - 1);
+			for(unsigned int i = 1; i < _threads; i++)
+				_pool.emplace_back(&BatchRunner::work, this, i, std::ref(_results));
+			work(0, _results);
+			for(std::thread& _thread : _pool)
+				_thread.join();
+
+			m_jobs.clear();
+			return _results;
+		}
+
+		const unsigned int BatchRunner::getThreadCount() const
+		{
+			return m_threadCount;
+		}
+
+		const size_t BatchRunner::getPendingCount() const
+		{
+			return m_jobs.size();
+		}
+
+		/******************************************************************************/
+		void BatchRunner::work(unsigned int index, std::vector<BatchResult>& results)
+		{
+			size_t _job;
+			while(takeJob(index, _job))
+				runJob(m_workers[index].machine, m_jobs[_job], results[_job]);
+		}
+
+		bool BatchRunner::takeJob(unsigned int index, size_t& job)
+		{
+			Worker& _self = m_workers[index];
+			{
+				std::lock_guard<std::mutex> _lock(_self.lock);
+				if(_self.begin < _self.end)
+				{
+					job = _self.begin++;
+					return true;
+				}
+			}
+
+			/* Jobs never add jobs, so once every block is empty the batch is done */
+			for(unsigned int i = 1; i < m_threadCount; i++)
+			{
+				Worker& _victim = m_workers[(index + i) % m_threadCount];
+				size_t _begin, _end;
+				{
+					std::lock_guard<std::mutex> _lock(_victim.lock);
+					const size_t _left = _victim.end - _victim.begin;
+					if(_left == 0)
+						continue;
+
+					_end = _victim.end;
+					_begin = _end - (_left + 1) / 2;
+					_victim.end = _begin;
+				}
+
+				std::lock_guard<std::mutex> _lock(_self.lock);
+				job = _begin;
+				_self.begin = _begin + 1;
+				_self.end = _end;
+				return true;
+			}
+			return false;
+		}
+
+		void BatchRunner::runJob(BF_Machine& machine, const BatchJob& job, BatchResult& result)
+		{
+			SharedSource _input(job.input.get());
+			ResultSink _output(result.output);
+
+			machine.reset();
+			machine.loadProgram(job.program);
+			machine.setInputSource(&_input);
+			machine.setOutputSink(&_output);
+			machine.setState(MachineState::RUNNING);
+
+			result.result = machine.runBatch(job.limits);
+			result.ticks = machine.getTicks();
+			machine.flushStdOut();
+
+			machine.setInputSource(nullptr);
+			machine.setOutputSink(nullptr);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bfsim.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		struct BatchJob
+		{
+			std::shared_ptr<const Program> program;
+			std::shared_ptr<const std::string> input;	// nullptr runs with no input
+			RunLimits limits;
+		};
+
+		struct BatchResult
+		{
+			RunResult result;
+			size_t ticks;	// All the machine counted, ticks the program's prefix skipped included
+			std::string output;
+		};
+
+		/* Runs many independent jobs across a pool of worker threads. Jobs are dealt out in
+		* contiguous blocks, one per worker, and a worker that runs dry steals half of the
+		* remaining block of another. Each worker keeps one machine, so tape and I/O buffers are
+		* allocated once per worker, not once per job. Programs and inputs are shared read-only.
+		* The runner itself isn't synchronised, submit and run from one thread. */
+		class BatchRunner
+		{
+		public:
+
+			/* threads 0 uses one worker per hardware thread, guardedTape as in SimConfig */
+			explicit BatchRunner(int tapeSize, unsigned int threads = 0, bool guardedTape = false);
+			~BatchRunner();
+
+			BatchRunner(const BatchRunner&) = delete;
+			BatchRunner& operator=(const BatchRunner&) = delete;
+
+			/* Returns the job's index in the results of the next run() */
+			size_t submit(BatchJob job);
+
+			/* Runs every job submitted since the last run, returns their results in submission
+			* order. The calling thread works as one of the workers. */
+			std::vector<BatchResult> run();
+
+			const unsigned int getThreadCount() const;
+			const size_t getPendingCount() const;
+
+		private:
+
+			struct Worker;
+
+			void work(unsigned int index, std::vector<BatchResult>& results);
+			bool takeJob(unsigned int index, size_t& job);
+			void runJob(BF_Machine& machine, const BatchJob& job, BatchResult& result);
+
+		private:
+
+			SimConfig m_config;
+			std::vector<BatchJob> m_jobs;
+			std::unique_ptr<Worker[]> m_workers;
+			unsigned int m_threadCount;
+		};
+	}
+}
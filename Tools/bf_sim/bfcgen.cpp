@@ -0,0 +1,325 @@
+#include "bfcgen.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#if defined(BF_CGEN_AVAILABLE)
+	#include <dlfcn.h>
+	#include <pwd.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* Mirrors JitFrame, the generated code never includes simulator headers */
+		static const char* C_PRELUDE =
+			"#include <stddef.h>\n"
+			"typedef struct {\n"
+			"\tchar* cell; char* lo; char* hi; void* ctx;\n"
+			"\tint (*put)(void*, char); int (*get)(void*, char*);\n"
+			"\tsize_t (*scan)(const char*, size_t, size_t, int);\n"
+			"\tconst void* entry; unsigned int exitOp;\n"
+			"} JitFrame;\n"
+			"#define EXIT(op) do { f->cell = p; f->exitOp = (op); return; } while(0)\n"
+			"#define CLAMP(i) ((i) < 0 ? (ptrdiff_t)0 : (i) > hi - lo ? hi - lo : (i))\n";
+
+		/* Bounds checks clamp the index, a pointer past the tape is never formed */
+		static std::string cell(int offset, bool boundsChecks)
+		{
+			std::ostringstream _expr;
+			if(offset == 0)
+				_expr << "(*p)";
+			else if(boundsChecks)
+				_expr << "lo[CLAMP(p - lo + (" << offset << "))]";
+			else
+				_expr << "p[" << offset << "]";
+			return _expr.str();
+		}
+
+		static unsigned long long fnv1a(const std::string& data)
+		{
+			unsigned long long _hash = 14695981039346656037ull;
+			for(unsigned char _c : data)
+			{
+				_hash ^= _c;
+				_hash *= 1099511628211ull;
+			}
+			return _hash;
+		}
+
+#if defined(BF_CGEN_AVAILABLE)
+		static const char* C_FLAGS = "-O2 -shared -fPIC";
+
+		/* What "cc --version" prints, asked once per compiler. Objects are cached by it, an
+		* upgraded compiler builds them again */
+		static std::string compilerVersion(const std::string& cc)
+		{
+			static std::mutex _lock;
+			static std::map<std::string, std::string> _versions;
+
+			std::lock_guard<std::mutex> _guard(_lock);
+			auto _it = _versions.find(cc);
+			if(_it != _versions.end())
+				return _it->second;
+
+			std::string _version;
+			if(FILE* _pipe = popen((cc + " --version 2>/dev/null").c_str(), "r"))
+			{
+				char _buffer[256];
+				size_t _read;
+				while((_read = fread(_buffer, 1, sizeof(_buffer), _pipe)) > 0)
+					_version.append(_buffer, _read);
+				pclose(_pipe);
+			}
+			return _versions[cc] = _version;
+		}
+
+		/* Objects in the cache are loaded into the process, so it has to be a directory only
+		* this user can write to. Creates it and any missing parents with mode 0700, mkdir -p
+		* style, and checks what's there */
+		static bool makePrivateDir(const std::string& path)
+		{
+			for(size_t i = 1; i <= path.size(); i++)
+			{
+				if((i == path.size() || path[i] == '/') && mkdir(path.substr(0, i).c_str(), 0700) != 0 && errno != EEXIST)
+					return false;
+			}
+
+			struct stat _st;
+			return lstat(path.c_str(), &_st) == 0 && S_ISDIR(_st.st_mode) && _st.st_uid == getuid() && (_st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+		}
+
+		/* A file this user owns and nobody else can write to, the same goes for a cached object */
+		static bool isPrivateFile(const std::string& path)
+		{
+			struct stat _st;
+			return lstat(path.c_str(), &_st) == 0 && S_ISREG(_st.st_mode) && _st.st_uid == getuid() && (_st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+		}
+#endif
+
+		/******************************************************************************/
+		std::string emitC(const std::vector<Op>& program, bool boundsChecks)
+		{
+			std::ostringstream _src;
+			std::set<size_t> _entries; // Ops generated code can suspend at, plus the start
+
+			if(!program.empty())
+				_entries.insert(0);
+			for(size_t i = 0; i < program.size(); i++)
+			{
+				if(program[i].code == OpCode::OUT || program[i].code == OpCode::IN || program[i].code == OpCode::SCAN)
+					_entries.insert(i);
+
+				/* The host may finish an I/O op itself and resume right after it */
+				if((program[i].code == OpCode::OUT || program[i].code == OpCode::IN) && i + 1 < program.size())
+					_entries.insert(i + 1);
+			}
+
+			_src << C_PRELUDE
+				<< "void bf_run(JitFrame* f)\n{\n"
+				<< "\tchar* p = f->cell;\n"
+				<< "\tchar* const lo = f->lo;\n"
+				<< "\tchar* const hi = f->hi;\n"
+				<< "\tswitch(f->exitOp)\n\t{\n";
+			for(size_t _entry : _entries)
+				_src << "\t\tcase " << _entry << ": goto op" << _entry << ";\n";
+			_src << "\t\tdefault: EXIT(" << program.size() << ");\n\t}\n";
+
+			std::string _indent = "\t";
+			for(size_t i = 0; i < program.size(); i++)
+			{
+				const Op& _op = program[i];
+
+				if(_op.code == OpCode::JNZ)
+				{
+					if(_entries.count(i))
+						_src << "op" << i << ": ;\n"; // Resuming here re-tests the loop condition
+					_indent.pop_back();
+					_src << _indent << "}\n";
+					continue;
+				}
+
+				if(_entries.count(i))
+					_src << "op" << i << ":\n";
+
+				switch(_op.code)
+				{
+					case OpCode::ADD:
+						_src << _indent << cell(_op.offset, boundsChecks) << " += " << _op.arg << ";\n";
+						break;
+
+					case OpCode::MOVE:
+						if(boundsChecks)
+							_src << _indent << "p = lo + CLAMP(p - lo + (" << _op.arg << "));\n";
+						else
+							_src << _indent << "p += " << _op.arg << ";\n";
+						break;
+
+					case OpCode::OUT:
+						_src << _indent << "if(f->put(f->ctx, " << cell(_op.offset, boundsChecks) << ")) EXIT(" << i << ");\n";
+						break;
+
+					case OpCode::IN:
+						_src << _indent << "if(f->get(f->ctx, &" << cell(_op.offset, boundsChecks) << ")) EXIT(" << i << ");\n";
+						break;
+
+					case OpCode::JZ:
+						_src << _indent << "while(*p)\n" << _indent << "{\n";
+						_indent.push_back('\t');
+						break;
+
+					case OpCode::CLEAR:
+						_src << _indent << cell(_op.offset, boundsChecks) << " = 0;\n";
+						break;
+
+					case OpCode::MULADD:
+						_src << _indent << cell(_op.offset, boundsChecks) << " += (char)(" << cell(_op.srcOffset, boundsChecks) << " * " << _op.arg << ");\n";
+						break;
+
+					case OpCode::SCAN:
+						_src << _indent << "{\n"
+							<< _indent << "\tsize_t z = f->scan(lo, (size_t)(hi - lo) + 1, (size_t)(p - lo), " << _op.arg << ");\n"
+							<< _indent << "\tif(z != (size_t)-1) p = lo + z;\n"
+							<< _indent << "\telse { p = " << (_op.arg > 0 ? "hi" : "lo") << "; if(*p) EXIT(" << i << "); }\n"
+							<< _indent << "}\n";
+						break;
+
+					default:
+						break;
+				}
+			}
+
+			_src << "\tEXIT(" << program.size() << ");\n}\n";
+			return _src.str();
+		}
+
+		/******************************************************************************/
+		NativeProgram::NativeProgram() :
+			m_handle(nullptr),
+			m_entry(nullptr)
+		{
+		}
+
+		NativeProgram::~NativeProgram()
+		{
+			release();
+		}
+
+		bool NativeProgram::compile(const std::vector<Op>& program, bool boundsChecks)
+		{
+			release();
+
+#if defined(BF_CGEN_AVAILABLE)
+			const std::string _source = emitC(program, boundsChecks);
+			const char* _cc = getenv("CC") ? getenv("CC") : "cc";
+
+			/* Cache directory, never a shared one: without HOME the password database has it */
+			std::string _cacheDir;
+			if(getenv("BFPU_CACHE_DIR"))
+				_cacheDir = getenv("BFPU_CACHE_DIR");
+			else if(getenv("XDG_CACHE_HOME"))
+				_cacheDir = std::string(getenv("XDG_CACHE_HOME")) + "/bfpu";
+			else if(getenv("HOME"))
+				_cacheDir = std::string(getenv("HOME")) + "/.cache/bfpu";
+			else
+			{
+				struct passwd _entry;
+				struct passwd* _user = nullptr;
+				char _buffer[4096];
+				if(getpwuid_r(getuid(), &_entry, _buffer, sizeof(_buffer), &_user) != 0 || !_user || !_user->pw_dir || !*_user->pw_dir)
+					return false;
+				_cacheDir = std::string(_user->pw_dir) + "/.cache/bfpu";
+			}
+			if(!makePrivateDir(_cacheDir))
+				return false;
+
+			/* Keyed by everything that goes into the object */
+			char _hash[17];
+			snprintf(_hash, sizeof(_hash), "%016llx", fnv1a(_source + '\0' + _cc + '\0' + C_FLAGS + '\0' + compilerVersion(_cc)));
+			const std::string _base = _cacheDir + "/bf_" + _hash;
+			m_objectPath = _base + ".so";
+
+			struct stat _st;
+			if(lstat(m_objectPath.c_str(), &_st) != 0)
+			{
+				/* Build under a per-process, per-build name and rename, so concurrent builds never see a partial object */
+				static std::atomic<unsigned int> _buildCounter(0);
+				const std::string _tmp = _base + "." + std::to_string(getpid()) + "." + std::to_string(_buildCounter++);
+				FILE* _file = fopen((_tmp + ".c").c_str(), "w");
+				if(!_file)
+					return false;
+				fwrite(_source.data(), 1, _source.size(), _file);
+				fclose(_file);
+
+				std::string _cmd = std::string(_cc) + " " + C_FLAGS + " -o '" + _tmp + ".so' '" + _tmp + ".c'";
+				const bool _built = system(_cmd.c_str()) == 0 && rename((_tmp + ".so").c_str(), m_objectPath.c_str()) == 0;
+				remove((_tmp + ".c").c_str());
+				if(!_built)
+				{
+					remove((_tmp + ".so").c_str());
+					return false;
+				}
+			}
+
+			if(!isPrivateFile(m_objectPath))
+				return false;
+			m_handle = dlopen(m_objectPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+			if(!m_handle)
+				return false;
+
+			m_entry = (void (*)(JitFrame*))dlsym(m_handle, "bf_run");
+			if(!m_entry)
+			{
+				release();
+				return false;
+			}
+			return true;
+#else
+			(void)program;
+			(void)boundsChecks;
+			return false;
+#endif
+		}
+
+		void NativeProgram::release()
+		{
+#if defined(BF_CGEN_AVAILABLE)
+			if(m_handle)
+				dlclose(m_handle);
+#endif
+			m_handle = nullptr;
+			m_entry = nullptr;
+		}
+
+		unsigned int NativeProgram::run(JitFrame& frame, unsigned int startOp) const
+		{
+			if(!m_entry)
+				return startOp;
+
+			frame.exitOp = startOp;
+			m_entry(&frame);
+			return frame.exitOp;
+		}
+
+		const bool NativeProgram::isCompiled() const
+		{
+			return m_entry != nullptr;
+		}
+
+		const std::string& NativeProgram::getObjectPath() const
+		{
+			return m_objectPath;
+		}
+	}
+}
\ No newline at end of file
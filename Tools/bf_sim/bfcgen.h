@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "bfir.h"
+#include "bfx64.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define BF_CGEN_AVAILABLE
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/******************************************************************************/
+		/* Emits C source for the IR. The code exports "void bf_run(JitFrame* frame)" which starts
+		* at op frame->exitOp (0, the program end, or an op the code itself suspended at) and
+		* otherwise follows the JitFrame contract of the x86-64 backend. */
+		std::string emitC(const std::vector<Op>& program, bool boundsChecks);
+
+		/* IR compiled with the system C compiler into a shared object and loaded with dlopen.
+		* Objects are cached on disk by hash of the generated source, compiler, flags and compiler
+		* version, so loading the same program again skips the compiler. Compiler is $CC (default
+		* "cc"), cache directory is $BFPU_CACHE_DIR, $XDG_CACHE_HOME/bfpu or ~/.cache/bfpu. It
+		* must belong to this user and nobody else may write to it, nor to the objects in it. */
+		class NativeProgram
+		{
+		public:
+
+			NativeProgram();
+			~NativeProgram();
+
+			NativeProgram(const NativeProgram&) = delete;
+			NativeProgram& operator=(const NativeProgram&) = delete;
+
+			/* Returns false if dlopen isn't available, the compiler failed or the object can't be loaded */
+			bool compile(const std::vector<Op>& program, bool boundsChecks);
+			void release();
+
+			/* Runs from op "startOp" until the program ends or an I/O callback suspends.
+			* Returns the op to resume at (op count when halted). */
+			unsigned int run(JitFrame& frame, unsigned int startOp) const;
+
+			const bool isCompiled() const;
+			const std::string& getObjectPath() const;
+
+		private:
+
+			void* m_handle;
+			void (*m_entry)(JitFrame*);
+			std::string m_objectPath;
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "bfcoro.h"
+
+#if defined(BF_COROUTINES_AVAILABLE)
+
+#include <utility>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		Execution::Execution(std::coroutine_handle<promise_type> handle) :
+			m_handle(handle)
+		{
+		}
+
+		Execution::Execution(Execution&& other) noexcept :
+			m_handle(std::exchange(other.m_handle, nullptr))
+		{
+		}
+
+		Execution& Execution::operator=(Execution&& other) noexcept
+		{
+			if(this != &other)
+			{
+				if(m_handle)
+					m_handle.destroy();
+				m_handle = std::exchange(other.m_handle, nullptr);
+			}
+			return *this;
+		}
+
+		Execution::~Execution()
+		{
+			if(m_handle)
+				m_handle.destroy();
+		}
+
+		bool Execution::resume()
+		{
+			if(!m_handle || m_handle.done())
+				return false;
+
+			m_handle.resume();
+			return !m_handle.done();
+		}
+
+		const bool Execution::isDone() const
+		{
+			return !m_handle || m_handle.done();
+		}
+
+		const StopReason Execution::getWaitReason() const
+		{
+			return m_handle ? m_handle.promise().waitReason : StopReason::HALTED;
+		}
+
+		const size_t Execution::getTicks() const
+		{
+			return m_handle ? m_handle.promise().ticks : 0;
+		}
+
+		/******************************************************************************/
+		Execution execute(BF_Machine& machine, size_t sliceTicks)
+		{
+			RunLimits _limits;
+			_limits.stopOnInput = true;
+			if(sliceTicks > 0)
+				_limits.maxTicks = sliceTicks;
+
+			while(true)
+			{
+				RunResult _result = machine.runBatch(_limits);
+				if(_result.reason == StopReason::HALTED || _result.reason == StopReason::TAPE_FAULT)
+					co_return _result;
+				co_await Execution::Wait{ _result };
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+	#if __has_include(<coroutine>)
+		#define BF_COROUTINES_AVAILABLE
+	#endif
+#endif
+
+#if defined(BF_COROUTINES_AVAILABLE)
+
+#include <coroutine>
+
+#include "bfsim.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* A machine run as a C++20 coroutine. It starts suspended. resume() runs the machine on
+		* the calling thread until it halts or has to wait, then returns. A waiting machine needs
+		* input (feedStdIn()/closeStdIn()) or room for output (consumeStdOut() or a sink that
+		* takes more) before the next resume(). Suspending is a plain return from resume(), so
+		* any number of executions can be multiplexed on one thread. */
+		class Execution
+		{
+		public:
+
+			struct promise_type
+			{
+				StopReason waitReason = StopReason::TICK_LIMIT;
+				size_t ticks = 0;
+
+				Execution get_return_object() { return Execution(std::coroutine_handle<promise_type>::from_promise(*this)); }
+				std::suspend_always initial_suspend() noexcept { return {}; }
+				std::suspend_always final_suspend() noexcept { return {}; }
+				void return_value(const RunResult& result) { waitReason = result.reason; ticks += result.ticks; }
+				void unhandled_exception() { throw; }
+			};
+
+			/* What an execution co_awaits, records why the batch it just ran stopped */
+			struct Wait
+			{
+				RunResult result;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
+				{
+					handle.promise().waitReason = result.reason;
+					handle.promise().ticks += result.ticks;
+				}
+				void await_resume() const noexcept {}
+			};
+
+			Execution(Execution&& other) noexcept;
+			Execution& operator=(Execution&& other) noexcept;
+			~Execution();
+
+			Execution(const Execution&) = delete;
+			Execution& operator=(const Execution&) = delete;
+
+			/* Returns false once the machine has halted or faulted */
+			bool resume();
+
+			const bool isDone() const;
+			/* INPUT_NEEDED, OUTPUT_FULL or TICK_LIMIT (slice used up) while suspended, HALTED or TAPE_FAULT when done */
+			const StopReason getWaitReason() const;
+			/* Ticks run over all resumes, 0 for JIT and NATIVE */
+			const size_t getTicks() const;
+
+		private:
+
+			explicit Execution(std::coroutine_handle<promise_type> handle);
+
+		private:
+
+			std::coroutine_handle<promise_type> m_handle;
+		};
+
+		/* Runs "machine", which must outlive the execution, waiting on I/O instead of reading
+		* an empty stdin as end of input. sliceTicks > 0 also suspends after that many ticks, so
+		* long computations yield too. */
+		Execution execute(BF_Machine& machine, size_t sliceTicks = 0);
+	}
+}
+
+#endif
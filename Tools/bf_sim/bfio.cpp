@@ -0,0 +1,256 @@
+#include "bfio.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <io.h>
+	#define BF_READ(fd, buf, size) _read(fd, buf, (unsigned int)(size))
+	#define BF_WRITE(fd, buf, size) _write(fd, buf, (unsigned int)(size))
+#else
+	#include <sys/uio.h>
+	#include <unistd.h>
+	#define BF_READ(fd, buf, size) ::read(fd, buf, size)
+	#define BF_WRITE(fd, buf, size) ::write(fd, buf, size)
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		RingBuffer::RingBuffer(size_t capacity)
+		{
+			reset(capacity);
+		}
+
+		void RingBuffer::reset(size_t capacity)
+		{
+			size_t _size = 1;
+			while(_size < capacity)
+				_size <<= 1;
+
+			m_data.assign(_size, (char)0);
+			m_mask = _size - 1;
+			m_head = 0;
+			m_tail = 0;
+		}
+
+		size_t RingBuffer::write(const char* data, size_t size)
+		{
+			size_t _done = 0;
+			while(_done < size)
+			{
+				char* _dst;
+				size_t _n = writable(&_dst);
+				if(_n == 0)
+					break;
+				if(_n > size - _done)
+					_n = size - _done;
+				memcpy(_dst, data + _done, _n);
+				commit(_n);
+				_done += _n;
+			}
+			return _done;
+		}
+
+		size_t RingBuffer::read(char* data, size_t size)
+		{
+			size_t _done = 0;
+			while(_done < size)
+			{
+				const char* _src;
+				size_t _n = readable(&_src);
+				if(_n == 0)
+					break;
+				if(_n > size - _done)
+					_n = size - _done;
+				memcpy(data + _done, _src, _n);
+				consume(_n);
+				_done += _n;
+			}
+			return _done;
+		}
+
+		size_t RingBuffer::readable(const char** data) const
+		{
+			const size_t _start = m_head & m_mask;
+			const size_t _toEnd = m_data.size() - _start;
+			*data = m_data.data() + _start;
+			return size() < _toEnd ? size() : _toEnd;
+		}
+
+		size_t RingBuffer::readable(const char** first, size_t* firstSize, const char** second, size_t* secondSize) const
+		{
+			*firstSize = readable(first);
+			*second = m_data.data();
+			*secondSize = size() - *firstSize;
+			return size();
+		}
+
+		size_t RingBuffer::writable(char** data)
+		{
+			const size_t _start = m_tail & m_mask;
+			const size_t _toEnd = m_data.size() - _start;
+			const size_t _free = m_data.size() - size();
+			*data = m_data.data() + _start;
+			return _free < _toEnd ? _free : _toEnd;
+		}
+
+		std::string RingBuffer::str() const
+		{
+			std::string _out;
+			_out.reserve(size());
+			for(size_t i = m_head; i != m_tail; i++)
+				_out.push_back(m_data[i & m_mask]);
+			return _out;
+		}
+
+		/******************************************************************************/
+		MemorySource::MemorySource(std::string data) :
+			m_data(std::move(data)),
+			m_pos(0)
+		{
+		}
+
+		long MemorySource::read(char* buffer, size_t size)
+		{
+			if(m_pos >= m_data.size())
+				return END;
+
+			size_t _n = m_data.size() - m_pos;
+			if(_n > size)
+				_n = size;
+			memcpy(buffer, m_data.data() + m_pos, _n);
+			m_pos += _n;
+			return (long)_n;
+		}
+
+		FdSource::FdSource(int fd) :
+			m_fd(fd)
+		{
+		}
+
+		long FdSource::read(char* buffer, size_t size)
+		{
+			long _n;
+			do
+				_n = (long)BF_READ(m_fd, buffer, size);
+			while(_n < 0 && errno == EINTR);
+
+			/* Read errors end the input like EOF does */
+			return _n > 0 ? _n : END;
+		}
+
+		CallbackSource::CallbackSource(Callback callback) :
+			m_callback(std::move(callback))
+		{
+		}
+
+		long CallbackSource::read(char* buffer, size_t size)
+		{
+			return m_callback(buffer, size);
+		}
+
+		/******************************************************************************/
+		size_t OutputSink::writeParts(const char* first, size_t firstSize, const char* second, size_t secondSize)
+		{
+			size_t _taken = write(first, firstSize);
+			if(_taken < firstSize || secondSize == 0)
+				return _taken;
+			return _taken + write(second, secondSize);
+		}
+
+		MemorySink::MemorySink(size_t maxSize) :
+			m_maxSize(maxSize)
+		{
+		}
+
+		size_t MemorySink::write(const char* data, size_t size)
+		{
+			const size_t _free = m_maxSize - m_data.size();
+			if(size > _free)
+				size = _free;
+			m_data.append(data, size);
+			return size;
+		}
+
+		const std::string& MemorySink::getData() const
+		{
+			return m_data;
+		}
+
+		void MemorySink::clear()
+		{
+			m_data.clear();
+		}
+
+		FdSink::FdSink(int fd) :
+			m_fd(fd),
+			m_failed(false)
+		{
+		}
+
+		size_t FdSink::write(const char* data, size_t size)
+		{
+			size_t _done = 0;
+			while(!m_failed && _done < size)
+			{
+				long _n = (long)BF_WRITE(m_fd, data + _done, size - _done);
+				if(_n < 0 && errno == EINTR)
+					continue;
+				if(_n <= 0)
+					m_failed = true;
+				else
+					_done += (size_t)_n;
+			}
+			return _done;
+		}
+
+		size_t FdSink::writeParts(const char* first, size_t firstSize, const char* second, size_t secondSize)
+		{
+#if defined(_WIN32)
+			return OutputSink::writeParts(first, firstSize, second, secondSize);
+#else
+			size_t _done = 0;
+			const size_t _total = firstSize + secondSize;
+			while(!m_failed && _done < _total)
+			{
+				/* Whatever a short write left of both runs */
+				struct iovec _iov[2];
+				int _count = 0;
+				if(_done < firstSize)
+					_iov[_count++] = { (void*)(first + _done), firstSize - _done };
+				const size_t _secondDone = _done > firstSize ? _done - firstSize : 0;
+				if(_secondDone < secondSize)
+					_iov[_count++] = { (void*)(second + _secondDone), secondSize - _secondDone };
+
+				long _n = (long)::writev(m_fd, _iov, _count);
+				if(_n < 0 && errno == EINTR)
+					continue;
+				if(_n <= 0)
+					m_failed = true;
+				else
+					_done += (size_t)_n;
+			}
+			return _done;
+#endif
+		}
+
+		const bool FdSink::hasFailed() const
+		{
+			return m_failed;
+		}
+
+		CallbackSink::CallbackSink(Callback callback) :
+			m_callback(std::move(callback))
+		{
+		}
+
+		size_t CallbackSink::write(const char* data, size_t size)
+		{
+			return m_callback(data, size);
+		}
+	}
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* Fixed-capacity byte FIFO. Capacity is rounded up to a power of two so positions wrap
+		* with a mask. push()/pop() expect the caller to have checked full()/empty(). */
+		class RingBuffer
+		{
+		public:
+
+			explicit RingBuffer(size_t capacity = 0);
+
+			void reset(size_t capacity);
+			void clear() { m_head = m_tail = 0; }
+
+			bool empty() const { return m_head == m_tail; }
+			bool full() const { return m_tail - m_head == m_data.size(); }
+			size_t size() const { return m_tail - m_head; }
+			size_t capacity() const { return m_data.size(); }
+
+			void push(char value) { m_data[m_tail++ & m_mask] = value; }
+			char pop() { return m_data[m_head++ & m_mask]; }
+
+			/* Copying bulk transfers, return the number of bytes moved */
+			size_t write(const char* data, size_t size);
+			size_t read(char* data, size_t size);
+
+			/* Zero-copy access: the longest contiguous run of queued bytes, then drop "size" of them */
+			size_t readable(const char** data) const;
+			/* Both runs of queued bytes, the second is empty unless the data wraps. Returns the total */
+			size_t readable(const char** first, size_t* firstSize, const char** second, size_t* secondSize) const;
+			void consume(size_t size) { m_head += size; }
+
+			/* Zero-copy access: the longest contiguous run of free space, then queue "size" bytes written there */
+			size_t writable(char** data);
+			void commit(size_t size) { m_tail += size; }
+
+			/* Copy of the queued bytes, oldest first */
+			std::string str() const;
+
+		private:
+
+			std::vector<char> m_data;
+			size_t m_mask;
+			size_t m_head; // Total bytes popped, only ever grows
+			size_t m_tail; // Total bytes pushed, only ever grows
+		};
+
+		/******************************************************************************/
+		/* Where "," gets its bytes from once the machine's input buffer runs dry */
+		class InputSource
+		{
+		public:
+
+			static const long END = -1;
+
+			virtual ~InputSource() = default;
+
+			/* Bytes read into buffer, 0 if none are available yet (the machine waits), END at end of input */
+			virtual long read(char* buffer, size_t size) = 0;
+		};
+
+		/* Where "." bytes go once the machine's output buffer fills up. Data points straight into
+		* the machine's buffer and is only valid during the call. */
+		class OutputSink
+		{
+		public:
+
+			virtual ~OutputSink() = default;
+
+			/* Bytes taken, fewer than size when the sink can't take more yet (the machine waits) */
+			virtual size_t write(const char* data, size_t size) = 0;
+
+			/* Two runs in order, used when buffered output wraps around. Returns like write() */
+			virtual size_t writeParts(const char* first, size_t firstSize, const char* second, size_t secondSize);
+		};
+
+		/******************************************************************************/
+		class MemorySource : public InputSource
+		{
+		public:
+
+			explicit MemorySource(std::string data = std::string());
+
+			long read(char* buffer, size_t size) override;
+
+		private:
+
+			std::string m_data;
+			size_t m_pos;
+		};
+
+		/* Blocking read() on a file descriptor, which the caller keeps owning */
+		class FdSource : public InputSource
+		{
+		public:
+
+			explicit FdSource(int fd);
+
+			long read(char* buffer, size_t size) override;
+
+		private:
+
+			int m_fd;
+		};
+
+		/* Returns like InputSource::read */
+		class CallbackSource : public InputSource
+		{
+		public:
+
+			typedef std::function<long(char* buffer, size_t size)> Callback;
+
+			explicit CallbackSource(Callback callback);
+
+			long read(char* buffer, size_t size) override;
+
+		private:
+
+			Callback m_callback;
+		};
+
+		/******************************************************************************/
+		/* Collects output in memory, takes at most maxSize bytes in total */
+		class MemorySink : public OutputSink
+		{
+		public:
+
+			explicit MemorySink(size_t maxSize = (size_t)-1);
+
+			size_t write(const char* data, size_t size) override;
+
+			const std::string& getData() const;
+			void clear();
+
+		private:
+
+			std::string m_data;
+			size_t m_maxSize;
+		};
+
+		/* Blocking write() on a file descriptor, which the caller keeps owning. Wrapped output goes
+		* out in a single writev() where available. After a write error the sink takes nothing, so
+		* the machine stops with its output full. */
+		class FdSink : public OutputSink
+		{
+		public:
+
+			explicit FdSink(int fd);
+
+			size_t write(const char* data, size_t size) override;
+			size_t writeParts(const char* first, size_t firstSize, const char* second, size_t secondSize) override;
+
+			const bool hasFailed() const;
+
+		private:
+
+			int m_fd;
+			bool m_failed;
+		};
+
+		/* Returns like OutputSink::write */
+		class CallbackSink : public OutputSink
+		{
+		public:
+
+			typedef std::function<size_t(const char* data, size_t size)> Callback;
+
+			explicit CallbackSink(Callback callback);
+
+			size_t write(const char* data, size_t size) override;
+
+		private:
+
+			Callback m_callback;
+		};
+	}
+}
@@ -0,0 +1,1217 @@
+#include "bfir.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		static void emitOp(std::vector<Op>& program, OpCode code, int arg, unsigned int instrIdx)
+		{
+			program.push_back({ code, arg, 0, 0, 0, instrIdx });
+		}
+
+		/* Loop between JZ at "begin" and JNZ at "end" as a scan, clear or MULADDs, false if none fits */
+		static bool lowerLoopIdiom(const std::vector<Op>& program, size_t begin, size_t end, const Dialect& dialect, std::vector<Op>& out)
+		{
+			const unsigned int _instrIdx = program[begin].instrIdx;
+
+			/* [>] [<] [>>>>] */
+			if(end - begin == 2 && program[begin + 1].code == OpCode::MOVE)
+			{
+				emitOp(out, OpCode::SCAN, program[begin + 1].arg, _instrIdx);
+				return true;
+			}
+
+			/* Only straight-line ADD/MOVE bodies from here on */
+			const bool _saturate = dialect.overflow == Overflow::SATURATE;
+			std::map<int, long long> _deltas;
+			std::map<int, int> _adds;
+			int _offset = 0;
+
+			for(size_t i = begin + 1; i < end; i++)
+			{
+				const Op& _op = program[i];
+				if(_op.code == OpCode::ADD)
+				{
+					_deltas[_offset + _op.offset] += _op.arg;
+					_adds[_offset + _op.offset]++;
+				}
+				else if(_op.code == OpCode::MOVE)
+					_offset += _op.arg;
+				else
+					return false;
+			}
+
+			if(_offset != 0)
+				return false;
+
+			/* Saturating cells only take one add per cell */
+			if(_saturate)
+			{
+				for(const auto& _count : _adds)
+				{
+					if(_count.second > 1)
+						return false;
+				}
+			}
+
+			const int _counterDelta = wrapDelta(_deltas[0], dialect);
+
+			/* [-] [+], any odd step when wrapping, only down when saturating */
+			if(_deltas.size() == 1)
+			{
+				if(_saturate ? _counterDelta >= 0 : (_counterDelta & 1) == 0)
+					return false;
+
+				emitOp(out, OpCode::CLEAR, 0, _instrIdx);
+				return true;
+			}
+
+			/* [->+<] [->++>+++<<] and friends, counting up only when wrapping */
+			if(_counterDelta != -1 && (_counterDelta != 1 || _saturate))
+				return false;
+
+			for(const auto& _delta : _deltas)
+			{
+				if(_delta.first == 0 || wrapDelta(_delta.second, dialect) == 0)
+					continue;
+
+				const int _step = wrapDelta(_delta.second, dialect);
+				emitOp(out, OpCode::MULADD, _counterDelta == -1 ? _step : -_step, _instrIdx);
+				out.back().offset = _delta.first;
+			}
+			emitOp(out, OpCode::CLEAR, 0, _instrIdx);
+
+			/* Kept behind the loop's jumps where an access can fault or grow */
+			if(dialect.edge == TapeEdge::ERROR || dialect.edge == TapeEdge::GROW)
+			{
+				out.insert(out.begin(), program[begin]);
+				out.push_back(program[end]);
+			}
+			return true;
+		}
+
+		/* Cell value as an affine function of the cells at loop entry, modulo 2^bits, or unknown */
+		struct Affine
+		{
+			uint64_t constant = 0;
+			std::map<int, uint64_t> terms;	// Factor per entry cell offset, none of them zero
+			bool unknown = false;
+
+			bool isConstant() const { return !unknown && terms.empty(); }
+		};
+
+		static void addScaled(Affine& to, const Affine& from, uint64_t factor, uint64_t mask)
+		{
+			to.unknown = to.unknown || from.unknown;
+			to.constant = (to.constant + from.constant * factor) & mask;
+			for(const auto& _term : from.terms)
+			{
+				const uint64_t _factor = (to.terms[_term.first] + _term.second * factor) & mask;
+				if(_factor == 0)
+					to.terms.erase(_term.first);
+				else
+					to.terms[_term.first] = _factor;
+			}
+		}
+
+		/* Cell value as an op argument, false if it doesn't fit one */
+		static bool toArg(uint64_t value, uint64_t mask, int& arg)
+		{
+			const uint64_t _sign = (mask >> 1) + 1;
+			const long long _value = (value & _sign) ? (long long)(value | ~mask) : (long long)value;
+			if(_value < INT_MIN || _value > INT_MAX)
+				return false;
+			arg = (int)_value;
+			return true;
+		}
+
+		/* Index of the JNZ closing the JZ at "begin", jump targets may be stale */
+		static size_t findLoopEnd(const std::vector<Op>& program, size_t begin)
+		{
+			int _depth = 0;
+			for(size_t i = begin; ; i++)
+			{
+				if(program[i].code == OpCode::JZ)
+					_depth++;
+				else if(program[i].code == OpCode::JNZ && --_depth == 0)
+					return i;
+			}
+		}
+
+		/* Ops [begin, end) once on symbolic cells, false on I/O, scans and loops that move DP */
+		static bool evaluateAffine(const std::vector<Op>& program, size_t begin, size_t end, uint64_t mask, std::map<int, Affine>& cells, int& offset)
+		{
+			auto _value = [&](int cell) -> Affine {
+				const auto _found = cells.find(cell);
+				if(_found != cells.end())
+					return _found->second;
+				Affine _entry;
+				_entry.terms[cell] = 1;
+				return _entry;
+			};
+
+			for(size_t i = begin; i < end; i++)
+			{
+				const Op& _op = program[i];
+				switch(_op.code)
+				{
+					case OpCode::ADD:
+					{
+						Affine _cell = _value(offset + _op.offset);
+						_cell.constant = (_cell.constant + (uint64_t)(long long)_op.arg) & mask;
+						cells[offset + _op.offset] = _cell;
+						break;
+					}
+
+					case OpCode::MOVE:
+						offset += _op.arg;
+						break;
+
+					case OpCode::CLEAR:
+						cells[offset + _op.offset] = Affine();
+						break;
+
+					case OpCode::MULADD:
+					{
+						Affine _cell = _value(offset + _op.offset);
+						addScaled(_cell, _value(offset + _op.srcOffset), (uint64_t)(long long)_op.arg, mask);
+						cells[offset + _op.offset] = _cell;
+						break;
+					}
+
+					case OpCode::JZ:
+					{
+						const size_t _end = findLoopEnd(program, i);
+						const Affine _counter = _value(offset);
+						if(_counter.isConstant() && _counter.constant == 0)
+						{
+							i = _end;
+							break;
+						}
+
+						if(_counter.isConstant())
+						{
+							std::map<int, Affine> _pass = cells;
+							int _passOffset = offset;
+							if(!evaluateAffine(program, i + 1, _end, mask, _pass, _passOffset))
+								return false;
+							const auto _after = _pass.find(offset);
+							if(_passOffset == offset && _after != _pass.end() && _after->second.isConstant() && _after->second.constant == 0)
+							{
+								cells.swap(_pass);
+								i = _end;
+								break;
+							}
+						}
+
+						/* Runs an unknown number of times */
+						std::vector<int> _loops;
+						int _at = offset;
+						for(size_t j = i; j <= _end; j++)
+						{
+							const Op& _inner = program[j];
+							switch(_inner.code)
+							{
+								case OpCode::ADD:
+								case OpCode::CLEAR:
+								case OpCode::MULADD:
+									cells[_at + _inner.offset].unknown = true;
+									break;
+								case OpCode::MOVE: _at += _inner.arg; break;
+								case OpCode::JZ: _loops.push_back(_at); break;
+								case OpCode::JNZ:
+									if(_loops.back() != _at)
+										return false;
+									_loops.pop_back();
+									break;
+								default:
+									return false;
+							}
+						}
+						cells[offset] = Affine();
+						i = _end;
+						break;
+					}
+
+					default:
+						return false;
+				}
+			}
+			return true;
+		}
+
+		/* Every pass of a balanced loop at once, see optimizeIdioms(). "guarded" if it needs one to run */
+		static bool emitClosedForm(const std::map<int, Affine>& cells, const std::map<int, Affine>& known, bool down, uint64_t mask, unsigned int instrIdx, std::vector<Op>& out, bool& guarded)
+		{
+			auto _emit = [&](OpCode code, int offset, uint64_t value, int srcOffset) -> bool {
+				int _arg = 0;
+				if(!toArg(value, mask, _arg))
+					return false;
+				emitOp(out, code, _arg, instrIdx);
+				out.back().offset = offset;
+				out.back().srcOffset = srcOffset;
+				return true;
+			};
+
+			std::map<int, uint64_t> _set;
+			for(const auto& _cell : cells)
+			{
+				if(_cell.first != 0 && _cell.second.isConstant())
+					_set[_cell.first] = _cell.second.constant;
+			}
+
+			for(const auto& _cell : cells)
+			{
+				if(_cell.first == 0 || _set.count(_cell.first) != 0)
+					continue;
+
+				const Affine& _value = _cell.second;
+				const auto _self = _value.terms.find(_cell.first);
+				if(_value.unknown || _self == _value.terms.end() || _self->second != 1)
+					return false;
+
+				uint64_t _perPass = _value.constant;
+				uint64_t _firstPass = 0;
+				for(const auto& _term : _value.terms)
+				{
+					if(_term.first == _cell.first)
+						continue;
+					const auto _source = _set.find(_term.first);
+					if(_source == _set.end() || !_emit(OpCode::MULADD, _cell.first, _term.second, _term.first))
+						return false;
+					_perPass = (_perPass + _term.second * _source->second) & mask;
+					_firstPass = (_firstPass + _term.second * _source->second) & mask;
+				}
+
+				if(_perPass != 0 && !_emit(OpCode::MULADD, _cell.first, down ? _perPass : (0 - _perPass) & mask, 0))
+					return false;
+				if(_firstPass != 0 && !_emit(OpCode::ADD, _cell.first, (0 - _firstPass) & mask, 0))
+					return false;
+			}
+
+			guarded = false;
+			for(const auto& _cell : _set)
+			{
+				const auto _known = known.find(_cell.first);
+				if(_known != known.end() && _known->second.constant == _cell.second)
+					continue;
+
+				guarded = true;
+				_emit(OpCode::CLEAR, _cell.first, 0, 0);
+				if(_cell.second != 0 && !_emit(OpCode::ADD, _cell.first, _cell.second, 0))
+					return false;
+			}
+			_emit(OpCode::CLEAR, 0, 0, 0);
+			return true;
+		}
+
+		/* Closed form of a balanced counting loop, see optimizeIdioms() */
+		static bool lowerBalancedLoop(const std::vector<Op>& program, size_t begin, size_t end, const Dialect& dialect, std::vector<Op>& out)
+		{
+			if(dialect.overflow != Overflow::WRAP)
+				return false;
+
+			const uint64_t _mask = dialect.cellBits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << dialect.cellBits) - 1;
+			std::map<int, Affine> _cells;
+			int _offset = 0;
+			if(!evaluateAffine(program, begin + 1, end, _mask, _cells, _offset) || _offset != 0)
+				return false;
+
+			/* The counter runs cell[DP] times counting down, -cell[DP] times counting up */
+			bool _down = true;
+			auto _counts = [&](const std::map<int, Affine>& cells) -> bool {
+				const auto _counter = cells.find(0);
+				if(_counter == cells.end() || _counter->second.unknown || _counter->second.terms.size() != 1 ||
+					_counter->second.terms.count(0) == 0 || _counter->second.terms.at(0) != 1)
+					return false;
+				_down = _counter->second.constant == _mask;
+				return _down || _counter->second.constant == 1;
+			};
+
+			std::map<int, Affine> _known;
+			bool _unknown = false;
+			for(const auto& _cell : _cells)
+			{
+				if(_cell.first != 0 && _cell.second.isConstant())
+					_known[_cell.first] = _cell.second;
+				_unknown = _unknown || _cell.second.unknown;
+			}
+
+			const unsigned int _instrIdx = program[begin].instrIdx;
+			std::vector<Op> _body;
+			bool _guarded = false;
+			if(!_unknown)
+			{
+				if(!_counts(_cells) || !emitClosedForm(_cells, std::map<int, Affine>(), _down, _mask, _instrIdx, _body, _guarded))
+					return false;
+			}
+			else
+			{
+				/* Later passes start with the cells the first one set at their constants */
+				std::map<int, Affine> _later = _known;
+				std::vector<Op> _rest;
+				bool _restGuarded = false;
+				_offset = 0;
+				if(!evaluateAffine(program, begin + 1, end, _mask, _later, _offset) || _offset != 0 || !_counts(_later) ||
+					!emitClosedForm(_later, _known, _down, _mask, _instrIdx, _rest, _restGuarded))
+					return false;
+
+				_body.assign(program.begin() + begin + 1, program.begin() + end);
+				if(_restGuarded)
+					emitOp(_body, OpCode::JZ, 0, _instrIdx);
+				_body.insert(_body.end(), _rest.begin(), _rest.end());
+				if(_restGuarded)
+					emitOp(_body, OpCode::JNZ, 0, program[end].instrIdx);
+				_guarded = true;
+			}
+
+			/* The guard runs once, the counter is zero by the JNZ */
+			_guarded = _guarded || dialect.edge == TapeEdge::ERROR || dialect.edge == TapeEdge::GROW;
+			if(_guarded)
+				emitOp(out, OpCode::JZ, 0, _instrIdx);
+			out.insert(out.end(), _body.begin(), _body.end());
+			if(_guarded)
+				emitOp(out, OpCode::JNZ, 0, program[end].instrIdx);
+			return true;
+		}
+
+		/* Values a cell may hold for optimizeRanges(), lo to hi. "onTape" once an op accessed
+		* the cell, so it's known to be on the tape. */
+		struct CellRange
+		{
+			uint64_t lo;
+			uint64_t hi;
+			bool onTape;
+
+			bool isZero() const { return lo == 0 && hi == 0; }
+		};
+
+		/* What optimizeRanges() knows about the tape at one point of the program. Cells are keyed
+		* by position relative to the cell DP was on when the state started, so moves don't have
+		* to rekey them. */
+		struct RangeState
+		{
+			std::map<long long, CellRange> cells;
+			long long dp = 0;
+			bool zeroRest = false;	// Cells missing from the map are zero, otherwise they may hold anything
+			bool anchored = false;	// dp is the cell index, the run started on cell 0
+		};
+
+		/* Ops optimizeRanges() may walk again per op of the program, see walkRanges() */
+		static const size_t RANGE_REVISITS = 8;
+
+		static CellRange getRange(const RangeState& state, long long offset, uint64_t mask)
+		{
+			const auto _found = state.cells.find(state.dp + offset);
+			if(_found != state.cells.end())
+				return _found->second;
+			return { 0, state.zeroRest ? 0 : mask, false };
+		}
+
+		static void setRange(RangeState& state, long long offset, uint64_t lo, uint64_t hi)
+		{
+			state.cells[state.dp + offset] = { lo, hi, true };
+		}
+
+		static void killRange(RangeState& state, long long offset, uint64_t mask)
+		{
+			const auto _found = state.cells.find(state.dp + offset);
+			if(_found != state.cells.end())
+			{
+				_found->second.lo = 0;
+				_found->second.hi = mask;
+			}
+			else if(state.zeroRest)
+				state.cells[state.dp + offset] = { 0, mask, false };
+		}
+
+		/* Moves every value of "range" up or down by minMagnitude to maxMagnitude. Returns true
+		* if none of them wraps or saturates on the way. */
+		static bool addRange(CellRange& range, uint64_t minMagnitude, uint64_t maxMagnitude, bool up, Overflow overflow, uint64_t mask)
+		{
+			if(up ? maxMagnitude <= mask - range.hi : maxMagnitude <= range.lo)
+			{
+				range.lo = up ? range.lo + minMagnitude : range.lo - maxMagnitude;
+				range.hi = up ? range.hi + maxMagnitude : range.hi - minMagnitude;
+				return true;
+			}
+
+			if(overflow == Overflow::SATURATE)
+			{
+				/* Some values stop at the limit, the others still move */
+				if(up)
+				{
+					range.lo = minMagnitude > mask - range.lo ? mask : range.lo + minMagnitude;
+					range.hi = mask;
+				}
+				else
+				{
+					range.hi = minMagnitude > range.hi ? 0 : range.hi - minMagnitude;
+					range.lo = 0;
+				}
+			}
+			else if(range.lo == range.hi && minMagnitude == maxMagnitude)
+				range.lo = range.hi = (up ? range.lo + minMagnitude : range.lo - minMagnitude) & mask;
+			else
+			{
+				range.lo = 0;
+				range.hi = mask;
+			}
+			return false;
+		}
+
+		/* Magnitude of an ADD argument as the dialect's cells apply it */
+		static uint64_t addMagnitude(long long delta, Overflow overflow, uint64_t mask)
+		{
+			const uint64_t _magnitude = delta >= 0 ? (uint64_t)delta : (uint64_t)-delta;
+			return overflow == Overflow::WRAP ? _magnitude & mask : _magnitude;
+		}
+
+		/* Cells either state may hold, in the frame of "a" */
+		static RangeState joinRanges(const RangeState& a, const RangeState& b, uint64_t mask)
+		{
+			RangeState _joined;
+			_joined.dp = a.dp;
+			_joined.anchored = a.anchored && b.anchored && a.dp == b.dp;
+			_joined.zeroRest = _joined.anchored && a.zeroRest && b.zeroRest;
+
+			auto _join = [&](long long offset) {
+				const CellRange _a = getRange(a, offset, mask);
+				const CellRange _b = getRange(b, offset, mask);
+				const CellRange _cell = { std::min(_a.lo, _b.lo), std::max(_a.hi, _b.hi), _a.onTape && _b.onTape };
+				if(_joined.zeroRest || _cell.onTape || _cell.lo != 0 || _cell.hi != mask)
+					_joined.cells[_joined.dp + offset] = _cell;
+			};
+			for(const auto& _cell : a.cells)
+				_join(_cell.first - a.dp);
+			for(const auto& _cell : b.cells)
+				_join(_cell.first - b.dp);
+			return _joined;
+		}
+
+		/* A run that goes left of cell 0 clamps, faults or grows the tape there, and under CLAMP
+		* one that goes past "tapeCells" stops at the last cell. Past that point what's known no
+		* longer lines up with the offsets, and code kept in place keeps the fault. Without an
+		* anchor the end could be anywhere, there CLAMP only trusts the DP's own cell. */
+		static bool offTape(const RangeState& state, long long offset, const Dialect& dialect, size_t tapeCells)
+		{
+			const bool _clamp = dialect.edge == TapeEdge::CLAMP;
+			const long long _cell = state.dp + offset;
+			return offset != 0 && (state.anchored ? _cell < 0 || (_clamp && _cell >= (long long)tapeCells) : _clamp);
+		}
+
+		static void checkTape(RangeState& state, long long offset, const Dialect& dialect, size_t tapeCells)
+		{
+			if(offTape(state, offset, dialect, tapeCells))
+				state = RangeState();
+		}
+
+		/* Whether an op that accesses the cell may go. Under ERROR and GROW the access may be
+		* what faults or grows the tape, unless the cell is known to be on it. */
+		static bool canDrop(const RangeState& state, long long offset, const Dialect& dialect, uint64_t mask)
+		{
+			return offset == 0 || dialect.edge == TapeEdge::CLAMP || getRange(state, offset, mask).onTape;
+		}
+
+		/* Cells the loop between JZ at "begin" and JNZ at "end" may write in a pass, relative to
+		* DP at its start, and the lowest and highest cell it reaches. False if DP may end a pass
+		* elsewhere. */
+		static bool collectWrites(const std::vector<Op>& program, size_t begin, size_t end, std::set<long long>& writes, long long& low, long long& high)
+		{
+			long long _dp = 0;
+			low = high = 0;
+			for(size_t i = begin + 1; i < end; i++)
+			{
+				const Op& _op = program[i];
+				low = std::min(low, _dp + std::min(_op.offset, _op.srcOffset));
+				high = std::max(high, _dp + std::max(_op.offset, _op.srcOffset));
+				switch(_op.code)
+				{
+					case OpCode::MOVE:
+						_dp += _op.arg;
+						low = std::min(low, _dp);
+						high = std::max(high, _dp);
+						break;
+
+					case OpCode::ADD:
+					case OpCode::IN:
+					case OpCode::CLEAR:
+					case OpCode::MULADD:
+						writes.insert(_dp + _op.offset);
+						break;
+
+					case OpCode::JZ:
+					{
+						std::set<long long> _inner;
+						long long _innerLow = 0, _innerHigh = 0;
+						if(!collectWrites(program, i, _op.target, _inner, _innerLow, _innerHigh))
+							return false;
+						for(const long long _write : _inner)
+							writes.insert(_dp + _write);
+						low = std::min(low, _dp + _innerLow);
+						high = std::max(high, _dp + _innerHigh);
+						i = _op.target;
+						break;
+					}
+
+					case OpCode::SCAN:
+						return false;
+
+					default:
+						break;
+				}
+			}
+			return _dp == 0;
+		}
+
+		/* Runs ops [begin, end) on "state" and appends to "out" what's left for them to do. A
+		* loop is first followed for one pass from the cells at its entry, while "budget" lasts:
+		* if its cell is zero again by then it runs at most once. Otherwise its body is walked
+		* with every cell it writes unknown, which holds for any pass. */
+		static void walkRanges(const std::vector<Op>& program, size_t begin, size_t end, const Dialect& dialect, size_t tapeCells, uint64_t mask, RangeState& state, std::vector<Op>& out, size_t& budget)
+		{
+			size_t _mergeAt = SIZE_MAX;	// out.size() right after an ADD the next one may fold into
+			CellRange _mergeFrom = {};	// Its cell before it ran
+
+			for(size_t i = begin; i < end; i++)
+			{
+				const Op& _op = program[i];
+				switch(_op.code)
+				{
+					case OpCode::ADD:
+					{
+						checkTape(state, _op.offset, dialect, tapeCells);
+						const CellRange _before = getRange(state, _op.offset, mask);
+						CellRange _after = _before;
+						const uint64_t _magnitude = addMagnitude(_op.arg, dialect.overflow, mask);
+						const bool _exact = addRange(_after, _magnitude, _magnitude, _op.arg >= 0, dialect.overflow, mask);
+						setRange(state, _op.offset, _after.lo, _after.hi);
+
+						/* After an add that can't have saturated, the next one to the same cell folds in */
+						Op* _last = out.empty() ? nullptr : &out.back();
+						const long long _sum = _last ? (long long)_last->arg + _op.arg : 0;
+						if(_mergeAt == out.size() && _last->code == OpCode::ADD && _last->offset == _op.offset && _sum >= INT_MIN && _sum <= INT_MAX)
+						{
+							_last->arg = dialect.overflow == Overflow::WRAP ? wrapDelta(_sum, dialect) : (int)_sum;
+							CellRange _merged = _mergeFrom;
+							const uint64_t _mergedMagnitude = addMagnitude(_last->arg, dialect.overflow, mask);
+							if(_last->arg == 0)
+							{
+								out.pop_back();
+								_mergeAt = SIZE_MAX;
+							}
+							else if(!addRange(_merged, _mergedMagnitude, _mergedMagnitude, _last->arg >= 0, dialect.overflow, mask) && dialect.overflow != Overflow::WRAP)
+								_mergeAt = SIZE_MAX;
+							break;
+						}
+
+						out.push_back(_op);
+						_mergeAt = _exact || dialect.overflow == Overflow::WRAP ? out.size() : SIZE_MAX;
+						_mergeFrom = _before;
+						break;
+					}
+
+					case OpCode::MOVE:
+						out.push_back(_op);
+						checkTape(state, _op.arg, dialect, tapeCells);
+						state.dp += _op.arg;
+						break;
+
+					case OpCode::OUT:
+					{
+						checkTape(state, _op.offset, dialect, tapeCells);
+						const CellRange _cell = getRange(state, _op.offset, mask);
+						setRange(state, _op.offset, _cell.lo, _cell.hi);
+						out.push_back(_op);
+						break;
+					}
+
+					case OpCode::IN:
+					{
+						/* A byte, or at the end of input what the dialect leaves in the cell */
+						checkTape(state, _op.offset, dialect, tapeCells);
+						const CellRange _cell = getRange(state, _op.offset, mask);
+						uint64_t _hi = 0xFF;
+						if(dialect.eof == EofMode::UNCHANGED)
+							_hi = std::max(_hi, _cell.hi);
+						else if(dialect.eof == EofMode::ALL_ONES)
+							_hi = mask;
+						setRange(state, _op.offset, 0, _hi);
+						out.push_back(_op);
+						break;
+					}
+
+					case OpCode::CLEAR:
+						checkTape(state, _op.offset, dialect, tapeCells);
+						if(getRange(state, _op.offset, mask).isZero() && canDrop(state, _op.offset, dialect, mask))
+							break;
+						setRange(state, _op.offset, 0, 0);
+						out.push_back(_op);
+						break;
+
+					case OpCode::MULADD:
+					{
+						checkTape(state, _op.offset, dialect, tapeCells);
+						checkTape(state, _op.srcOffset, dialect, tapeCells);
+						const CellRange _src = getRange(state, _op.srcOffset, mask);
+						CellRange _cell = getRange(state, _op.offset, mask);
+						const bool _dropSrc = canDrop(state, _op.srcOffset, dialect, mask);
+						if(_src.isZero() && _dropSrc && canDrop(state, _op.offset, dialect, mask))
+							break;
+
+						/* Products stop at UINT64_MAX like CellMath, a known one wraps with the cells */
+						const uint64_t _factor = _op.arg >= 0 ? (uint64_t)_op.arg : (uint64_t)-(long long)_op.arg;
+						auto _product = [&](uint64_t value) -> uint64_t {
+							return _factor != 0 && value > UINT64_MAX / _factor ? UINT64_MAX : value * _factor;
+						};
+						uint64_t _lo = _product(_src.lo);
+						uint64_t _hi = _product(_src.hi);
+						if(dialect.overflow == Overflow::WRAP && _src.lo == _src.hi)
+							_lo = _hi = (_src.lo * _factor) & mask;
+						addRange(_cell, _lo, _hi, _op.arg >= 0, dialect.overflow, mask);
+
+						/* A known source makes it a plain add */
+						Op _add = _op;
+						bool _fits = false;
+						if(dialect.overflow == Overflow::WRAP)
+							_fits = toArg(_op.arg >= 0 ? _lo : (0 - _lo) & mask, mask, _add.arg);
+						else if(_lo <= (uint64_t)INT_MAX)
+						{
+							_add.arg = _op.arg >= 0 ? (int)_lo : -(int)_lo;
+							_fits = true;
+						}
+						if(_src.lo == _src.hi && _dropSrc && _fits && _add.arg != 0)
+						{
+							_add.code = OpCode::ADD;
+							_add.srcOffset = 0;
+							out.push_back(_add);
+						}
+						else
+						{
+							out.push_back(_op);
+							setRange(state, _op.srcOffset, _src.lo, _src.hi);
+						}
+						setRange(state, _op.offset, _cell.lo, _cell.hi);
+						break;
+					}
+
+					case OpCode::SCAN:
+						if(getRange(state, 0, mask).isZero())
+							break;
+						out.push_back(_op);
+						state = RangeState();
+						setRange(state, 0, 0, 0);
+						break;
+
+					case OpCode::JZ:
+					{
+						const size_t _begin = i;
+						const size_t _end = _op.target;
+						const CellRange _cell = getRange(state, 0, mask);
+						i = _end;
+						if(_cell.isZero())
+							break; // Never runs
+
+						std::set<long long> _writes;
+						long long _low = 0, _high = 0;
+						const bool _balanced = collectWrites(program, _begin, _end, _writes, _low, _high);
+						std::vector<Op> _body;
+
+						if(_balanced && _writes.count(0) != 0 && budget >= _end - _begin)
+						{
+							budget -= _end - _begin;
+							RangeState _once = state;
+							setRange(_once, 0, std::max<uint64_t>(_cell.lo, 1), _cell.hi);
+							walkRanges(program, _begin + 1, _end, dialect, tapeCells, mask, _once, _body, budget);
+							if(getRange(_once, 0, mask).isZero())
+							{
+								/* Runs at most once, a cell known to be non-zero runs it without the jumps */
+								if(_cell.lo == 0)
+								{
+									out.push_back(program[_begin]);
+									out.insert(out.end(), _body.begin(), _body.end());
+									out.push_back(program[_end]);
+									setRange(state, 0, 0, 0);
+									state = joinRanges(state, _once, mask);
+								}
+								else
+								{
+									out.insert(out.end(), _body.begin(), _body.end());
+									state = _once;
+								}
+								break;
+							}
+							_body.clear();
+						}
+
+						/* Any number of passes, they only line up while none of them gets to the tape's end */
+						RangeState _head = state;
+						if(!_balanced || offTape(state, _low, dialect, tapeCells) || offTape(state, _high, dialect, tapeCells))
+							_head = RangeState();
+						for(const long long _write : _writes)
+							killRange(_head, _write, mask);
+
+						RangeState _pass = _head;
+						const CellRange _headCell = getRange(_head, 0, mask);
+						setRange(_pass, 0, std::max<uint64_t>(_headCell.lo, 1), _headCell.hi);
+						walkRanges(program, _begin + 1, _end, dialect, tapeCells, mask, _pass, _body, budget);
+
+						/* It ends at JZ with the cells at entry or at JNZ after some pass */
+						out.push_back(program[_begin]);
+						out.insert(out.end(), _body.begin(), _body.end());
+						out.push_back(program[_end]);
+						setRange(state, 0, 0, 0);
+						setRange(_pass, 0, 0, 0);
+						state = joinRanges(state, _pass, mask);
+						break;
+					}
+
+					default:
+						out.push_back(_op);
+						break;
+				}
+			}
+		}
+
+		/******************************************************************************/
+		std::string stripSource(const std::string& source)
+		{
+			const std::string _SYNTAX = "><+-.,[]";
+
+			std::string _progMem = source;
+			_progMem.erase(std::remove_if(_progMem.begin(), _progMem.end(), [&_SYNTAX](const char& c) {
+				return _SYNTAX.find(c) == std::string::npos;
+			}), _progMem.end());
+			return _progMem;
+		}
+
+		bool matchBrackets(const std::string& progMem, std::vector<unsigned int>& jumpTable)
+		{
+			std::vector<unsigned int> _openBrackets;
+			jumpTable.assign(progMem.length(), 0);
+
+			for(unsigned int i = 0; i < progMem.length(); i++)
+			{
+				if(progMem[i] == '[')
+					_openBrackets.push_back(i);
+				else if(progMem[i] == ']')
+				{
+					if(_openBrackets.empty())
+						return false;
+
+					jumpTable[i] = _openBrackets.back();
+					jumpTable[_openBrackets.back()] = i;
+					_openBrackets.pop_back();
+				}
+			}
+			return _openBrackets.empty();
+		}
+
+		bool Dialect::isClassic() const
+		{
+			return cellBits == 8 && overflow == Overflow::WRAP && eof == EofMode::UNCHANGED && edge == TapeEdge::CLAMP;
+		}
+
+		int wrapDelta(long long delta, const Dialect& dialect)
+		{
+			switch(dialect.cellBits)
+			{
+				case 8: return (signed char)delta;
+				case 16: return (short)delta;
+				default: return (int)delta; // Wider cells: deltas from source text never leave int range
+			}
+		}
+
+		/******************************************************************************/
+		std::vector<Op> compileProgram(const std::string& progMem, const Dialect& dialect)
+		{
+			std::vector<Op> _program;
+			std::vector<unsigned int> _openLoops;
+
+			_program.reserve(progMem.length());
+
+			for(unsigned int i = 0; i < progMem.length(); i++)
+			{
+				const char _instr = progMem[i];
+
+				switch(_instr)
+				{
+					case '+':
+					case '-':
+					case '>':
+					case '<':
+					{
+						const bool _isAdd = (_instr == '+' || _instr == '-');
+						const unsigned int _start = i;
+						int _sum = 0;
+
+						/* Fold the whole run, "+-" and "<>" pairs cancel each other out. Saturating cells
+						* stop at the top of the range and moves at the tape's end, so there a run only
+						* folds while it goes one way. Only a ring has no end. */
+						const bool _oneWay = _isAdd ? dialect.overflow == Overflow::SATURATE : dialect.edge != TapeEdge::WRAP;
+						for(; i < progMem.length(); i++)
+						{
+							const char _c = progMem[i];
+							if(_oneWay && _c != _instr) break;
+							if(_isAdd && _c == '+') _sum++;
+							else if(_isAdd && _c == '-') _sum--;
+							else if(!_isAdd && _c == '>') _sum++;
+							else if(!_isAdd && _c == '<') _sum--;
+							else break;
+						}
+						i--;
+
+						if(_sum != 0)
+							emitOp(_program, _isAdd ? OpCode::ADD : OpCode::MOVE, _sum, _start);
+						break;
+					}
+
+					case '.':
+						emitOp(_program, OpCode::OUT, 0, i);
+						break;
+
+					case ',':
+						emitOp(_program, OpCode::IN, 0, i);
+						break;
+
+					case '[':
+						_openLoops.push_back((unsigned int)_program.size());
+						emitOp(_program, OpCode::JZ, 0, i);
+						break;
+
+					case ']':
+					{
+						const unsigned int _open = _openLoops.back();
+						_openLoops.pop_back();
+
+						_program[_open].target = (unsigned int)_program.size();
+						emitOp(_program, OpCode::JNZ, 0, i);
+						_program.back().target = _open;
+						break;
+					}
+				}
+			}
+			return _program;
+		}
+
+		/* Lowest and highest cell, relative to DP at "begin", that ops [begin, end) access, or
+		* move to as well if "moves". Loops count as if they ran. */
+		static void spanOf(const std::vector<Op>& program, size_t begin, size_t end, bool moves, int& low, int& high)
+		{
+			int _at = 0;
+			low = high = 0;
+			for(size_t i = begin; i < end; i++)
+			{
+				const Op& _op = program[i];
+				int _cell = _at + _op.offset;
+				if(_op.code == OpCode::MOVE)
+				{
+					_at += _op.arg;
+					if(!moves)
+						continue;
+					_cell = _at;
+				}
+				low = std::min(low, _cell);
+				high = std::max(high, _cell);
+				if(_op.code == OpCode::MULADD)
+				{
+					low = std::min(low, _at + _op.srcOffset);
+					high = std::max(high, _at + _op.srcOffset);
+				}
+			}
+		}
+
+		/* Cells the DP may be on, lo to hi */
+		struct DpBounds
+		{
+			long long lo;
+			long long hi;
+		};
+
+		/* Follows the DP through ops [begin, end) on a CLAMP tape whose last cell is "last", and
+		* records where it may be at each JZ. A loop that doesn't keep the DP within where it
+		* entered widens it to the tape's end, walked again while "budget" lasts. */
+		static void boundDp(const std::vector<Op>& program, size_t begin, size_t end, long long last, DpBounds& dp, std::vector<DpBounds>& atLoops, size_t& budget)
+		{
+			for(size_t i = begin; i < end; i++)
+			{
+				const Op& _op = program[i];
+				if(_op.code == OpCode::MOVE)
+				{
+					dp.lo = std::min(std::max(dp.lo + _op.arg, 0LL), last);
+					dp.hi = std::min(std::max(dp.hi + _op.arg, 0LL), last);
+				}
+				else if(_op.code == OpCode::SCAN)
+				{
+					if(_op.arg > 0)
+						dp.hi = last;
+					else
+						dp.lo = 0;
+				}
+				else if(_op.code == OpCode::JZ)
+				{
+					const size_t _end = findLoopEnd(program, i);
+					DpBounds _pass = dp;
+					boundDp(program, i + 1, _end, last, _pass, atLoops, budget);
+					if(_pass.lo < dp.lo || _pass.hi > dp.hi)
+					{
+						dp.lo = _pass.lo < dp.lo ? 0 : dp.lo;
+						dp.hi = _pass.hi > dp.hi ? last : dp.hi;
+						_pass = dp;
+						if(budget >= _end - i)
+						{
+							budget -= _end - i;
+							boundDp(program, i + 1, _end, last, _pass, atLoops, budget);
+						}
+						else
+						{
+							dp = { 0, last };
+							for(size_t j = i + 1; j < _end; j++)
+								atLoops[j] = dp;
+						}
+					}
+					atLoops[i] = dp;
+					i = _end;
+				}
+			}
+		}
+
+		void optimizeIdioms(std::vector<Op>& program, const Dialect& dialect, size_t tapeCells)
+		{
+			std::vector<Op> _optimized;
+			std::vector<Op> _lowered;
+			std::vector<size_t> _openLoops;
+			std::vector<size_t> _openOps;
+			_optimized.reserve(program.size());
+
+			/* Without the tape's size the DP could be anywhere, only its own cell is known to be on it */
+			const long long _last = tapeCells > 0 ? (long long)tapeCells - 1 : LLONG_MAX / 2;
+			std::vector<DpBounds> _dpAtLoops;
+			if(dialect.edge == TapeEdge::CLAMP)
+			{
+				_dpAtLoops.assign(program.size(), { 0, _last });
+				if(tapeCells > 0)
+				{
+					DpBounds _dp = { 0, 0 };
+					size_t _budget = program.size() * RANGE_REVISITS;
+					boundDp(program, 0, program.size(), _last, _dp, _dpAtLoops, _budget);
+				}
+			}
+
+			for(size_t j = 0; j < program.size(); j++)
+			{
+				const Op& _op = program[j];
+				_optimized.push_back(_op);
+				if(_op.code == OpCode::JZ)
+				{
+					_openLoops.push_back(_optimized.size() - 1);
+					_openOps.push_back(j);
+				}
+				if(_op.code != OpCode::JNZ)
+					continue;
+
+				/* Loops inside were lowered when they closed, so nests collapse from the inside out */
+				const size_t _begin = _openLoops.back();
+				const size_t _beginOp = _openOps.back();
+				_openLoops.pop_back();
+				_openOps.pop_back();
+				_lowered.clear();
+				if(!lowerLoopIdiom(_optimized, _begin, _optimized.size() - 1, dialect, _lowered) &&
+					!lowerBalancedLoop(_optimized, _begin, _optimized.size() - 1, dialect, _lowered))
+					continue;
+
+				/* Lowered ops reach as far as the loop moves, "[<>-]" isn't a clear on cell 0 */
+				if(dialect.edge != TapeEdge::WRAP && _lowered[0].code != OpCode::SCAN)
+				{
+					int _low, _high, _reachLow, _reachHigh;
+					spanOf(_optimized, _begin, _optimized.size(), true, _low, _high);
+					spanOf(_lowered, 0, _lowered.size(), false, _reachLow, _reachHigh);
+					if(_reachLow > _low || _reachHigh < _high)
+						continue;
+
+					const DpBounds* _dp = dialect.edge == TapeEdge::CLAMP ? &_dpAtLoops[_beginOp] : nullptr;
+					if(_dp && (_dp->lo + std::min(_low, _reachLow) < 0 || _dp->hi + std::max(_high, _reachHigh) > _last))
+						continue;
+				}
+
+				_optimized.resize(_begin);
+				_optimized.insert(_optimized.end(), _lowered.begin(), _lowered.end());
+			}
+
+			program.swap(_optimized);
+			linkJumps(program);
+		}
+
+		void optimizeOffsets(std::vector<Op>& program, const Dialect& dialect)
+		{
+			std::vector<Op> _optimized;
+			_optimized.reserve(program.size());
+
+			int _pending = 0;
+			unsigned int _moveInstrIdx = 0;
+
+			/* Deferred moves and offsets from them only stay exact while the DP goes one way, the
+			* tape's end would stop it part way. A ring has no end. */
+			auto _turns = [&](int offset) {
+				return dialect.edge != TapeEdge::WRAP && _pending != 0 && offset != 0 && (_pending > 0) != (offset > 0);
+			};
+
+			for(const Op& _op : program)
+			{
+				switch(_op.code)
+				{
+					case OpCode::MOVE:
+						if(_turns(_op.arg))
+						{
+							emitOp(_optimized, OpCode::MOVE, _pending, _moveInstrIdx);
+							_pending = 0;
+						}
+						_pending += _op.arg;
+						_moveInstrIdx = _op.instrIdx;
+						continue;
+
+					case OpCode::JZ:
+					case OpCode::JNZ:
+					case OpCode::SCAN:
+						/* Block ends, loop conditions and scans work on the real DP */
+						if(_pending != 0)
+							emitOp(_optimized, OpCode::MOVE, _pending, _moveInstrIdx);
+						_pending = 0;
+						_optimized.push_back(_op);
+						continue;
+
+					default:
+						break;
+				}
+
+				if(_turns(_op.offset) || (_op.code == OpCode::MULADD && _turns(_op.srcOffset)))
+				{
+					emitOp(_optimized, OpCode::MOVE, _pending, _moveInstrIdx);
+					_pending = 0;
+				}
+
+				Op _shifted = _op;
+				_shifted.offset += _pending;
+				if(_shifted.code == OpCode::MULADD)
+					_shifted.srcOffset += _pending;
+
+				/* "+>-<+" leaves two adds to the same cell next to each other. Saturating cells
+				* only merge adds that go the same way. */
+				Op* _last = _optimized.empty() ? nullptr : &_optimized.back();
+				if(_shifted.code == OpCode::ADD && _last && _last->code == OpCode::ADD && _last->offset == _shifted.offset &&
+					(dialect.overflow == Overflow::WRAP || (_last->arg > 0) == (_shifted.arg > 0)))
+				{
+					_last->arg = wrapDelta((long long)_last->arg + _shifted.arg, dialect);
+					if(_last->arg == 0)
+						_optimized.pop_back();
+					continue;
+				}
+				_optimized.push_back(_shifted);
+			}
+
+			if(_pending != 0)
+				emitOp(_optimized, OpCode::MOVE, _pending, _moveInstrIdx);
+
+			program.swap(_optimized);
+			linkJumps(program);
+		}
+
+		void optimizeRanges(std::vector<Op>& program, const Dialect& dialect, size_t tapeCells)
+		{
+			/* How big a ring is isn't known yet, any two offsets may be the same cell */
+			if(dialect.edge == TapeEdge::WRAP)
+				return;
+
+			const uint64_t _mask = dialect.cellBits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << dialect.cellBits) - 1;
+
+			/* A run starts on cell 0 of a zeroed tape */
+			RangeState _state;
+			_state.zeroRest = true;
+			_state.anchored = true;
+			size_t _budget = program.size() * RANGE_REVISITS;
+
+			std::vector<Op> _optimized;
+			_optimized.reserve(program.size());
+			walkRanges(program, 0, program.size(), dialect, tapeCells, _mask, _state, _optimized, _budget);
+
+			program.swap(_optimized);
+			linkJumps(program);
+		}
+
+		void linkJumps(std::vector<Op>& program)
+		{
+			std::vector<unsigned int> _openLoops;
+
+			for(unsigned int i = 0; i < program.size(); i++)
+			{
+				if(program[i].code == OpCode::JZ)
+					_openLoops.push_back(i);
+				else if(program[i].code == OpCode::JNZ)
+				{
+					program[i].target = _openLoops.back();
+					program[_openLoops.back()].target = i;
+					_openLoops.pop_back();
+				}
+			}
+		}
+
+		const char* opCodeToStr(OpCode code)
+		{
+			switch(code)
+			{
+				case OpCode::ADD: return "ADD";
+				case OpCode::MOVE: return "MOVE";
+				case OpCode::OUT: return "OUT";
+				case OpCode::IN: return "IN";
+				case OpCode::JZ: return "JZ";
+				case OpCode::JNZ: return "JNZ";
+				case OpCode::CLEAR: return "CLEAR";
+				case OpCode::MULADD: return "MULADD";
+				case OpCode::SCAN: return "SCAN";
+				default: return "UNKNOWN";
+			}
+		}
+
+		const char* overflowToStr(Overflow overflow)
+		{
+			switch(overflow)
+			{
+				case Overflow::WRAP: return "wrap";
+				case Overflow::SATURATE: return "saturate";
+				default: return "UNKNOWN";
+			}
+		}
+
+		const char* eofModeToStr(EofMode mode)
+		{
+			switch(mode)
+			{
+				case EofMode::UNCHANGED: return "unchanged";
+				case EofMode::ZERO: return "zero";
+				case EofMode::ALL_ONES: return "all-ones";
+				default: return "UNKNOWN";
+			}
+		}
+
+		const char* tapeEdgeToStr(TapeEdge edge)
+		{
+			switch(edge)
+			{
+				case TapeEdge::CLAMP: return "clamp";
+				case TapeEdge::ERROR: return "error";
+				case TapeEdge::WRAP: return "wrap";
+				case TapeEdge::GROW: return "grow";
+				default: return "UNKNOWN";
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		enum class OpCode : unsigned char
+		{
+			ADD,	// cell[DP + offset] += arg
+			MOVE,	// DP += arg
+			OUT,	// Output cell[DP + offset]
+			IN,		// Read byte into cell[DP + offset]
+			JZ,		// If cell[DP] is zero, continue past matching JNZ
+			JNZ,	// If cell[DP] is non-zero, continue past matching JZ
+			CLEAR,	// cell[DP + offset] = 0
+			MULADD,	// cell[DP + offset] += cell[DP + srcOffset] * arg
+			SCAN,	// Move DP by arg until cell[DP] is zero
+		};
+
+		enum class Overflow
+		{
+			WRAP,		// Cells wrap around modulo 2^bits
+			SATURATE,	// Cells stick at 0 and at their maximum
+		};
+
+		enum class EofMode
+		{
+			UNCHANGED,	// "," at end of input leaves the cell alone
+			ZERO,		// ... stores 0
+			ALL_ONES,	// ... stores -1, all bits set
+		};
+
+		enum class TapeEdge
+		{
+			CLAMP,	// Moves stop at the first and last cell
+			ERROR,	// Going past either end faults the machine
+			WRAP,	// The tape is a ring
+			GROW,	// The tape grows at either end on demand, the cells reached span up to its size limit
+		};
+
+		/* Language variant a program is written for. Cells are unsigned, "," stores the byte read
+		* and "." writes the low byte of the cell. */
+		struct Dialect
+		{
+			unsigned int cellBits = 8;	// 8, 16, 32 or 64
+			Overflow overflow = Overflow::WRAP;
+			EofMode eof = EofMode::UNCHANGED;
+			TapeEdge edge = TapeEdge::CLAMP;
+
+			/* 8-bit wrapping cells, EOF leaves the cell alone, moves clamp. What every engine runs */
+			bool isClassic() const;
+			size_t getCellSize() const { return cellBits / 8; }
+		};
+
+		struct Op
+		{
+			OpCode code;
+			int arg;
+			int offset;
+			int srcOffset;
+			unsigned int target;	// Index of matching JZ/JNZ
+			unsigned int instrIdx;	// Program memory index of the first instruction folded into this op
+		};
+
+		/******************************************************************************/
+		/* Drops everything but the eight BF instructions */
+		std::string stripSource(const std::string& source);
+
+		/* Fills jumpTable with the index of the matching bracket for every "[" and "]".
+		* Returns false if brackets are unbalanced. */
+		bool matchBrackets(const std::string& progMem, std::vector<unsigned int>& jumpTable);
+
+		/* Lowers parsed program memory (syntax chars only, brackets balanced) into IR,
+		* folding runs of "+-" and "<>" into single ADD/MOVE ops. Saturating cells only fold
+		* runs that go one way, "+-" doesn't cancel at the top of the range. Moves do the same
+		* unless the tape is a ring: "<>" on cell 0 clamps, faults or grows the tape on the way. */
+		std::vector<Op> compileProgram(const std::string& progMem, const Dialect& dialect = Dialect());
+
+		/* Replaces loops matching common idioms with dedicated ops:
+		* "[-]" -> CLEAR, "[->++>+++<<]" -> MULADD... + CLEAR, "[>]" -> SCAN.
+		* Only loops that do the same as running them would under the dialect's cell width and
+		* overflow are replaced, so every engine gets the results of the stepping one:
+		* - Any odd step clears a wrapping cell, saturating cells only clear going down.
+		* - A MULADD loop runs cell[DP] times counting down, -cell[DP] counting up. Saturating
+		*   cells never wrap up to zero, and only take one add per cell: "+-" isn't "" at the top.
+		* - A zero counter skips the loop. Under ERROR and GROW the ops stay behind its jumps, so
+		*   they don't fault or grow the tape then.
+		* Balanced loops of wrapping cells, which end where they started and count DP down or up
+		* by one, get their closed form instead, nested ones included: "[>+++[>++<-]<-]" becomes
+		* a single pass of MULADD, ADD and CLEAR behind a JZ/JNZ guard. Every other cell either
+		* gets a constant k (a "set" cell y) or adds to itself a constant plus multiples of set
+		* cells. The first pass sees the set cells' entry values and later ones their constants:
+		*   x += a * y (entry values)
+		*   x += n * (k + a * ky) - a * ky
+		*   y = ky, counter = 0
+		* which only holds if there is a pass, hence the guard. When only later passes fit, say
+		* an inner loop's counter is only known once the first pass set it, the first pass runs
+		* as it is and the rest in closed form.
+		* Unless the tape is a ring its end stops, faults or grows at the farthest cell the loop
+		* moves to, and the lowered ops have to reach that far too. Under CLAMP a move past the
+		* end stops, so a loop is only replaced when every cell it reaches is provably on a tape
+		* of tapeCells from where the DP may be at its start. ">>+++[->+<]" on a 3-cell tape
+		* stays a loop. 0 proves no cell but the DP's own. */
+		void optimizeIdioms(std::vector<Op>& program, const Dialect& dialect = Dialect(), size_t tapeCells = 0);
+
+		/* Rewrites each basic block (straight-line code between loops and scans) into ops addressed
+		* relative to the DP at block entry, followed by a single MOVE at the block end.
+		* ">+>++<<-" becomes "ADD [DP+1] 1; ADD [DP+2] 2; ADD [DP] -1" with no pointer updates.
+		* Unless the tape is a ring a block also ends where the DP, or an op's offset, turns
+		* around. Every offset then lies between the DP and where it's headed, so clamping an access
+		* lands on the cell the moves one by one would have stopped at, and ERROR and GROW see the
+		* first cell past the tape. "<<<->>>." becomes "ADD [DP-3] -1; MOVE -3; OUT [DP+3]; MOVE 3". */
+		void optimizeOffsets(std::vector<Op>& program, const Dialect& dialect = Dialect());
+
+		/* Follows the range of values every cell may hold from a zeroed tape, through each basic
+		* block and loop, and drops what can't have an effect: loops whose cell is known to be
+		* zero, like a "[...]" comment at the start, clears of zero cells and MULADDs from zero.
+		* A loop whose cell is zero again after one pass loses its jumps when it's known to be
+		* entered, a MULADD from a known cell becomes an ADD, and saturating adds that can't reach
+		* either limit fold like wrapping ones. Going left of cell 0 forgets what's known, ERROR
+		* and GROW keep every access that could be the first past the tape, and rings (TapeEdge::WRAP)
+		* are left alone. Under CLAMP, going past "tapeCells" forgets what's known too: the ops are
+		* only right on a tape at least that long, 0 trusts no cell but the DP's own.
+		* Dropped loops leave moves next to each other, run optimizeOffsets() again after it. */
+		void optimizeRanges(std::vector<Op>& program, const Dialect& dialect = Dialect(), size_t tapeCells = 0);
+
+		/* Delta as the dialect's cells see it, wrapped to the cell width and sign-extended */
+		int wrapDelta(long long delta, const Dialect& dialect);
+
+		/* Recomputes JZ/JNZ targets after ops were inserted or removed */
+		void linkJumps(std::vector<Op>& program);
+
+		const char* opCodeToStr(OpCode code);
+		const char* overflowToStr(Overflow overflow);
+		const char* eofModeToStr(EofMode mode);
+		const char* tapeEdgeToStr(TapeEdge edge);
+	}
+}
\ No newline at end of file
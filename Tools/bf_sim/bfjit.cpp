@@ -0,0 +1,87 @@
+#include "bfjit.h"
+
+#if defined(BF_JIT_AVAILABLE)
+	#include <sys/mman.h>
+	#include <string.h>
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		JitProgram::JitProgram() :
+			m_code(nullptr),
+			m_codeSize(0)
+		{
+		}
+
+		JitProgram::~JitProgram()
+		{
+			release();
+		}
+
+		bool JitProgram::compile(const std::vector<Op>& program, const X64Options& options)
+		{
+			release();
+
+#if defined(BF_JIT_AVAILABLE)
+			X64Code _code;
+			emitX64(program, options, _code);
+
+			/* Write while RW, then flip to RX, never both at once */
+			void* _mem = mmap(nullptr, _code.bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(_mem == MAP_FAILED)
+				return false;
+
+			memcpy(_mem, _code.bytes.data(), _code.bytes.size());
+			if(mprotect(_mem, _code.bytes.size(), PROT_READ | PROT_EXEC) != 0)
+			{
+				munmap(_mem, _code.bytes.size());
+				return false;
+			}
+
+			m_code = _mem;
+			m_codeSize = _code.bytes.size();
+			m_opOffsets.swap(_code.opOffsets);
+			return true;
+#else
+			(void)program;
+			(void)options;
+			return false;
+#endif
+		}
+
+		void JitProgram::release()
+		{
+#if defined(BF_JIT_AVAILABLE)
+			if(m_code)
+				munmap(m_code, m_codeSize);
+#endif
+			m_code = nullptr;
+			m_codeSize = 0;
+			m_opOffsets.clear();
+		}
+
+		unsigned int JitProgram::run(JitFrame& frame, unsigned int startOp) const
+		{
+			if(!m_code || startOp >= m_opOffsets.size())
+				return startOp;
+
+			frame.entry = (const char*)m_code + m_opOffsets[startOp];
+			reinterpret_cast<void (*)(JitFrame*)>(m_code)(&frame);
+			return frame.exitOp;
+		}
+
+		const bool JitProgram::isCompiled() const
+		{
+			return m_code != nullptr;
+		}
+
+		const size_t JitProgram::getCodeSize() const
+		{
+			return m_codeSize;
+		}
+	}
+}
\ No newline at end of file
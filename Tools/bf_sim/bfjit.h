@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "bfir.h"
+#include "bfx64.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+	#define BF_JIT_AVAILABLE
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* IR compiled to native x86-64 code in an executable mapping */
+		class JitProgram
+		{
+		public:
+
+			JitProgram();
+			~JitProgram();
+
+			JitProgram(const JitProgram&) = delete;
+			JitProgram& operator=(const JitProgram&) = delete;
+
+			/* Returns false if the JIT isn't available on this platform or mapping the code failed */
+			bool compile(const std::vector<Op>& program, const X64Options& options);
+			void release();
+
+			/* Runs from op "startOp" until the program ends or an I/O callback suspends.
+			* Returns the op to resume at (op count when halted). */
+			unsigned int run(JitFrame& frame, unsigned int startOp) const;
+
+			const bool isCompiled() const;
+			const size_t getCodeSize() const;
+
+		private:
+
+			void* m_code;
+			size_t m_codeSize;
+			std::vector<unsigned int> m_opOffsets;
+		};
+	}
+}
\ No newline at end of file
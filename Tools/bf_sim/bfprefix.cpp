@@ -0,0 +1,139 @@
+#include "bfprefix.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		namespace
+		{
+			/* Cell arithmetic on 64-bit values kept to the cell width */
+			struct Cells
+			{
+				uint64_t mask;
+				bool saturate;
+
+				uint64_t addMagnitude(uint64_t cell, uint64_t magnitude, bool up) const
+				{
+					if(!saturate)
+						return (up ? cell + magnitude : cell - magnitude) & mask;
+					if(up)
+						return magnitude > mask - cell ? mask : cell + magnitude;
+					return magnitude > cell ? 0 : cell - magnitude;
+				}
+
+				uint64_t add(uint64_t cell, int delta) const
+				{
+					return delta >= 0 ? addMagnitude(cell, (uint64_t)delta, true) : addMagnitude(cell, (uint64_t)-(long long)delta, false);
+				}
+
+				uint64_t mulAdd(uint64_t cell, uint64_t src, int factor) const
+				{
+					if(!saturate)
+						return (cell + src * (uint64_t)(long long)factor) & mask;
+					const uint64_t _factor = factor >= 0 ? (uint64_t)factor : (uint64_t)-(long long)factor;
+					const uint64_t _product = _factor != 0 && src > UINT64_MAX / _factor ? UINT64_MAX : src * _factor;
+					return addMagnitude(cell, _product, factor >= 0);
+				}
+			};
+		}
+
+		Prefix evaluatePrefix(const std::vector<Op>& program, const Dialect& dialect, size_t maxTicks, size_t maxCells, size_t maxOutput)
+		{
+			const Cells _math = { dialect.cellBits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << dialect.cellBits) - 1, dialect.overflow == Overflow::SATURATE };
+
+			Prefix _prefix;
+			std::vector<uint64_t>& _cells = _prefix.cells;
+			size_t _pc = 0;
+			size_t _dp = 0;
+
+			/* Cell DP + offset, grown into the tape. False if it's off the part we may use */
+			auto _cell = [&](long long offset, size_t& index) -> bool {
+				const long long _index = (long long)_dp + offset;
+				if(_index < 0 || (size_t)_index >= maxCells)
+					return false;
+				index = (size_t)_index;
+				if(index >= _cells.size())
+					_cells.resize(index + 1, 0);
+				return true;
+			};
+
+			while(_pc < program.size() && _prefix.ticks < maxTicks)
+			{
+				const Op& _op = program[_pc];
+				size_t _i = 0;
+				size_t _src = 0;
+
+				switch(_op.code)
+				{
+					case OpCode::ADD:
+						if(!_cell(_op.offset, _i))
+							goto done;
+						_cells[_i] = _math.add(_cells[_i], _op.arg);
+						break;
+
+					case OpCode::MOVE:
+						if(!_cell(_op.arg, _i))
+							goto done;
+						_dp = _i;
+						break;
+
+					case OpCode::OUT:
+						if(_prefix.output.size() >= maxOutput || !_cell(_op.offset, _i))
+							goto done;
+						_prefix.output.push_back((char)_cells[_i]);
+						break;
+
+					case OpCode::IN:
+						goto done;
+
+					case OpCode::JZ:
+						if(!_cell(0, _i))
+							goto done;
+						if(_cells[_i] == 0)
+							_pc = _op.target;
+						break;
+
+					case OpCode::JNZ:
+						if(!_cell(0, _i))
+							goto done;
+						if(_cells[_i] != 0)
+							_pc = _op.target;
+						break;
+
+					case OpCode::CLEAR:
+						if(!_cell(_op.offset, _i))
+							goto done;
+						_cells[_i] = 0;
+						break;
+
+					case OpCode::MULADD:
+						if(!_cell(_op.srcOffset, _src) || !_cell(_op.offset, _i))
+							goto done;
+						_cells[_i] = _math.mulAdd(_cells[_i], _cells[_src], _op.arg);
+						break;
+
+					case OpCode::SCAN:
+					{
+						/* Past the cells in use everything is zero, only the left end can stop it */
+						long long _at = 0;
+						while(_cell(_at, _i) && _cells[_i] != 0)
+							_at += _op.arg;
+						if(!_cell(_at, _i))
+							goto done;
+						_dp = _i;
+						break;
+					}
+				}
+				_pc++;
+				_prefix.ticks++;
+			}
+
+		done:
+			_prefix.pc = (unsigned int)_pc;
+			_prefix.dp = _dp;
+			return _prefix;
+		}
+	}
+}
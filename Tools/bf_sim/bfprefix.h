@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "bfir.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* Where a program gets on its own before it first needs input. A machine with a zeroed
+		* tape at least cells.size() long may start there instead of at the first op. */
+		struct Prefix
+		{
+			unsigned int pc = 0;			// Op to resume at, op count if the program already ended
+			size_t dp = 0;					// Cell DP is on
+			size_t ticks = 0;				// Ops run, as THREADED counts them
+			std::vector<uint64_t> cells;	// Tape from cell 0, the rest stays zero
+			std::string output;				// Written so far
+		};
+
+		/******************************************************************************/
+		/* Runs the program from its first op on a zeroed tape, with the dialect's cell arithmetic,
+		* and stops before the first op that reads input, would run past maxTicks, touch a cell
+		* left of the start or at maxCells and beyond, or write more than maxOutput bytes. */
+		Prefix evaluatePrefix(const std::vector<Op>& program, const Dialect& dialect, size_t maxTicks, size_t maxCells = (size_t)1 << 16, size_t maxOutput = (size_t)1 << 16);
+	}
+}
@@ -0,0 +1,151 @@
+#include "bfprogram.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		std::shared_ptr<const Program> Program::build(const std::string& source, Engine engine, const Dialect& dialect, size_t prefixTicks, size_t tapeCells)
+		{
+			std::shared_ptr<Program> _program(new Program());
+			_program->m_prefixTicks = prefixTicks;
+			_program->m_tapeCells = tapeCells;
+
+			_program->m_progMem = stripSource(source);
+
+			/* Match all brackets once, so jumps don't have to walk the loop body at run time */
+			if(!matchBrackets(_program->m_progMem, _program->m_jumpTable))
+				return nullptr;
+
+			_program->m_dialect = dialect;
+			_program->m_ops = compileProgram(_program->m_progMem, dialect);
+			optimizeIdioms(_program->m_ops, dialect, tapeCells);
+			optimizeOffsets(_program->m_ops, dialect);
+			optimizeRanges(_program->m_ops, dialect, tapeCells);
+			optimizeOffsets(_program->m_ops, dialect);
+
+			_program->m_reach = 0;
+			for(const Op& _op : _program->m_ops)
+			{
+				if(_op.code == OpCode::MOVE || _op.code == OpCode::JZ || _op.code == OpCode::JNZ || _op.code == OpCode::SCAN)
+					continue;
+				const size_t _offset = (size_t)(_op.offset < 0 ? -(long long)_op.offset : _op.offset);
+				const size_t _srcOffset = (size_t)(_op.srcOffset < 0 ? -(long long)_op.srcOffset : _op.srcOffset);
+				if(_offset > _program->m_reach)
+					_program->m_reach = _offset;
+				if(_op.code == OpCode::MULADD && _srcOffset > _program->m_reach)
+					_program->m_reach = _srcOffset;
+			}
+
+			_program->m_engine = engine;
+			if(!dialect.isClassic())
+				_program->m_engine = engine = Engine::THREADED;
+			if(engine == Engine::JIT && !_program->m_jit.compile(_program->m_ops, X64Options()))
+				_program->m_engine = Engine::THREADED;
+			if(engine == Engine::NATIVE && !_program->m_native.compile(_program->m_ops, true))
+				_program->m_engine = Engine::THREADED;
+#if !defined(BF_JIT_AVAILABLE)
+			if(engine == Engine::TIERED)
+				_program->m_engine = Engine::THREADED;
+#endif
+
+			/* Stepping shows every instruction, it starts at the first one */
+			if(_program->m_engine != Engine::STEPPING && prefixTicks > 0)
+			{
+				_program->m_prefix = evaluatePrefix(_program->m_ops, dialect, prefixTicks);
+
+				/* Native code is only entered at I/O ops and the end, other stops start over */
+				const Prefix& _prefix = _program->m_prefix;
+				if(_program->m_engine == Engine::NATIVE && _prefix.pc < _program->m_ops.size() && _program->m_ops[_prefix.pc].code != OpCode::IN)
+					_program->m_prefix = Prefix();
+			}
+
+			return _program;
+		}
+
+		const std::shared_ptr<const Program>& Program::empty()
+		{
+			static const std::shared_ptr<const Program> _EMPTY = build("", Engine::STEPPING);
+			return _EMPTY;
+		}
+
+		std::shared_ptr<const Program> Program::rebuild(size_t tapeCells) const
+		{
+			return build(m_progMem, m_engine, m_dialect, m_prefixTicks, tapeCells);
+		}
+
+		/******************************************************************************/
+		const Engine Program::getEngine() const
+		{
+			return m_engine;
+		}
+
+		const Dialect& Program::getDialect() const
+		{
+			return m_dialect;
+		}
+
+		const std::string& Program::getProgMem() const
+		{
+			return m_progMem;
+		}
+
+		const std::vector<unsigned int>& Program::getJumpTable() const
+		{
+			return m_jumpTable;
+		}
+
+		const std::vector<Op>& Program::getOps() const
+		{
+			return m_ops;
+		}
+
+		const size_t Program::getReach() const
+		{
+			return m_reach;
+		}
+
+		const JitProgram& Program::getJit() const
+		{
+			return m_jit;
+		}
+
+		const NativeProgram& Program::getNative() const
+		{
+			return m_native;
+		}
+
+		const Prefix& Program::getPrefix() const
+		{
+			return m_prefix;
+		}
+
+		const size_t Program::getTapeCells() const
+		{
+			return m_tapeCells;
+		}
+
+		bool Program::compileTiered() const
+		{
+			std::call_once(m_tieredOnce, [&]() {
+				m_tiered = m_engine == Engine::TIERED && m_jit.compile(m_ops, X64Options());
+			});
+			return m_tiered;
+		}
+
+		const void* const* Program::getThreadedCode(const void* const* handlers, const void* end) const
+		{
+			std::lock_guard<std::mutex> _guard(m_threadedCodeLock);
+			std::vector<const void*>& _code = m_threadedCode[handlers];
+			if(_code.empty())
+			{
+				_code.resize(m_ops.size() + 1);
+				for(size_t i = 0; i < m_ops.size(); i++)
+					_code[i] = handlers[(int)m_ops[i].code];
+				_code[m_ops.size()] = end;
+			}
+			return _code.data();
+		}
+	}
+}
\ No newline at end of file
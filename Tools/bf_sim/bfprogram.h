@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bfcgen.h"
+#include "bfir.h"
+#include "bfjit.h"
+#include "bfprefix.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		enum class Engine
+		{
+			STEPPING,	// One source instruction per tick
+			IR,			// One folded IR op per tick
+			THREADED,	// Pre-decoded IR, runs many ops per call (computed goto where available)
+			JIT,		// Native x86-64 code, falls back to THREADED where unavailable. Doesn't count ticks
+			NATIVE,		// Generated C built by the system compiler and dlopen'ed, falls back to THREADED. Doesn't count ticks
+			TIERED,		// THREADED until a loop gets hot in an unbounded run, then JIT from its head on. Falls back to THREADED
+		};
+
+		/* Parsed and compiled program. Immutable once built, so a single instance can be shared
+		* by any number of machines, including machines running on different threads. */
+		class Program
+		{
+		public:
+
+			/* Strips, validates and lowers the source, then prepares the backend of the requested
+			* engine. Only THREADED runs dialects other than the classic one, any other engine
+			* falls back to it for them. With prefixTicks, up to that many ops before the first
+			* input run here already, see getPrefix(). STEPPING never skips any. Under CLAMP the ops
+			* are built for a tape of tapeCells and hold on any tape at least that long, 0 if the
+			* size isn't known yet, see optimizeRanges(). Returns nullptr if brackets are unbalanced. */
+			static std::shared_ptr<const Program> build(const std::string& source, Engine engine, const Dialect& dialect = Dialect(), size_t prefixTicks = 0, size_t tapeCells = 0);
+
+			/* The same source built again for a CLAMP tape of tapeCells, with the same settings */
+			std::shared_ptr<const Program> rebuild(size_t tapeCells) const;
+
+			/* Shared empty program, what a machine holds before anything is loaded */
+			static const std::shared_ptr<const Program>& empty();
+
+			Program(const Program&) = delete;
+			Program& operator=(const Program&) = delete;
+
+			const Engine getEngine() const;
+			const Dialect& getDialect() const;
+			const std::string& getProgMem() const;
+			const std::vector<unsigned int>& getJumpTable() const;
+			const std::vector<Op>& getOps() const;
+			const size_t getReach() const;	// Furthest an op reads or writes from DP, in cells. Moves not included
+			const JitProgram& getJit() const;	// Empty for TIERED until compileTiered()
+			const NativeProgram& getNative() const;
+			const Prefix& getPrefix() const;	// Where a fresh machine starts, empty unless built with prefixTicks
+			const size_t getTapeCells() const;	// Shortest CLAMP tape the ops hold on, see build()
+
+			/* TIERED: compiles the JIT code on the first call, thread-safe. False if that failed */
+			bool compileTiered() const;
+
+			/* Handler address per op plus "end" past the last one. Built on first use for each
+			* handler table, every threaded instantiation has its own, thread-safe */
+			const void* const* getThreadedCode(const void* const* handlers, const void* end) const;
+
+		private:
+
+			Program() = default;
+
+		private:
+
+			Engine m_engine;	// Requested engine, or THREADED if its backend isn't available
+			Dialect m_dialect;
+			std::string m_progMem;
+			std::vector<unsigned int> m_jumpTable; // Index of matching bracket for every "[" and "]"
+			std::vector<Op> m_ops;
+			size_t m_reach;
+			mutable JitProgram m_jit;
+			NativeProgram m_native;
+			Prefix m_prefix;
+			size_t m_prefixTicks;
+			size_t m_tapeCells;
+
+			mutable std::once_flag m_tieredOnce;
+			mutable bool m_tiered = false;	// compileTiered() succeeded
+			mutable std::mutex m_threadedCodeLock;
+			mutable std::map<const void* const*, std::vector<const void*>> m_threadedCode;	// By handler table
+		};
+	}
+}
\ No newline at end of file
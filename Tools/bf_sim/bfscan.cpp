@@ -0,0 +1,168 @@
+#include "bfscan.h"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define BF_SCAN_SSE2
+	#define BF_SCAN_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BF_SCAN_SSE2
+#endif
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		static size_t scanScalar(const char* memory, size_t size, size_t pos, int stride)
+		{
+			long long _idx = (long long)pos;
+
+			while(_idx >= 0 && _idx < (long long)size)
+			{
+				if(memory[_idx] == 0)
+					return (size_t)_idx;
+				_idx += stride;
+			}
+			return SCAN_NOT_FOUND;
+		}
+
+#if defined(BF_SCAN_SSE2)
+		static inline unsigned int lowestBit(unsigned int mask)
+		{
+#if defined(_MSC_VER)
+			unsigned long _idx;
+			_BitScanForward(&_idx, mask);
+			return _idx;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		static inline unsigned int highestBit(unsigned int mask)
+		{
+#if defined(_MSC_VER)
+			unsigned long _idx;
+			_BitScanReverse(&_idx, mask);
+			return _idx;
+#else
+			return 31 - __builtin_clz(mask);
+#endif
+		}
+
+		/* Bits of a 16-cell chunk mask visited by a scan with given stride, starting at bit 0 */
+		static inline unsigned int strideMask(unsigned int stride)
+		{
+			switch(stride)
+			{
+				case 1: return 0xFFFF;
+				case 2: return 0x5555;
+				case 4: return 0x1111;
+				default: return 0x0101;
+			}
+		}
+
+		static inline unsigned int zeroMask16(const char* chunk)
+		{
+			__m128i _cells = _mm_loadu_si128((const __m128i*)chunk);
+			return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_cells, _mm_setzero_si128()));
+		}
+
+		static size_t scanForward(const char* memory, size_t size, size_t pos, unsigned int stride)
+		{
+			const unsigned int _pattern = strideMask(stride);
+			size_t _idx = pos;
+
+			/* 64 cells per step; chunks always start at a visited cell so the pattern never shifts */
+			while(_idx + 64 <= size)
+			{
+#if defined(BF_SCAN_AVX2)
+				const __m256i _zero = _mm256_setzero_si256();
+				__m256i _lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(memory + _idx)), _zero);
+				__m256i _hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(memory + _idx + 32)), _zero);
+				if(_mm256_testz_si256(_mm256_or_si256(_lo, _hi), _mm256_or_si256(_lo, _hi)))
+				{
+					_idx += 64;
+					continue;
+				}
+#endif
+				for(unsigned int i = 0; i < 4; i++, _idx += 16)
+				{
+					unsigned int _mask = zeroMask16(memory + _idx) & _pattern;
+					if(_mask)
+						return _idx + lowestBit(_mask);
+				}
+			}
+
+			while(_idx + 16 <= size)
+			{
+				unsigned int _mask = zeroMask16(memory + _idx) & _pattern;
+				if(_mask)
+					return _idx + lowestBit(_mask);
+				_idx += 16;
+			}
+			return scanScalar(memory, size, _idx, (int)stride);
+		}
+
+		static size_t scanBackward(const char* memory, size_t size, size_t pos, unsigned int stride)
+		{
+			/* Chunk [idx - 15, idx], pattern anchored at bit 15 (the current cell) */
+			const unsigned int _pattern = strideMask(stride) << (stride - 1);
+			long long _idx = (long long)pos;
+
+			while(_idx >= 63)
+			{
+#if defined(BF_SCAN_AVX2)
+				const __m256i _zero = _mm256_setzero_si256();
+				__m256i _lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(memory + _idx - 63)), _zero);
+				__m256i _hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(memory + _idx - 31)), _zero);
+				if(_mm256_testz_si256(_mm256_or_si256(_lo, _hi), _mm256_or_si256(_lo, _hi)))
+				{
+					_idx -= 64;
+					continue;
+				}
+#endif
+				for(unsigned int i = 0; i < 4; i++, _idx -= 16)
+				{
+					unsigned int _mask = zeroMask16(memory + _idx - 15) & _pattern;
+					if(_mask)
+						return (size_t)(_idx - 15 + highestBit(_mask));
+				}
+			}
+
+			while(_idx >= 15)
+			{
+				unsigned int _mask = zeroMask16(memory + _idx - 15) & _pattern;
+				if(_mask)
+					return (size_t)(_idx - 15 + highestBit(_mask));
+				_idx -= 16;
+			}
+			return _idx < 0 ? SCAN_NOT_FOUND : scanScalar(memory, size, (size_t)_idx, -(int)stride);
+		}
+#endif
+
+		/******************************************************************************/
+		size_t scanZero(const char* memory, size_t size, size_t pos, int stride)
+		{
+			if(pos >= size)
+				return SCAN_NOT_FOUND;
+
+#if defined(BF_SCAN_SSE2)
+			switch(stride)
+			{
+				case 1: case 2: case 4: case 8:
+					return scanForward(memory, size, pos, (unsigned int)stride);
+
+				case -1: case -2: case -4: case -8:
+					return scanBackward(memory, size, pos, (unsigned int)-stride);
+			}
+#endif
+			return scanScalar(memory, size, pos, stride);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		static const size_t SCAN_NOT_FOUND = (size_t)-1;
+
+		/******************************************************************************/
+		/* Returns index of the first zero cell among pos, pos + stride, pos + 2 * stride...
+		* staying inside [0, size), or SCAN_NOT_FOUND when the scan runs off memory.
+		* Strides of 1, 2, 4 and 8 (either direction) are vectorized with SSE2/AVX2
+		* when the target supports it, the rest fall back to a plain loop. */
+		size_t scanZero(const char* memory, size_t size, size_t pos, int stride);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "bfsched.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		Scheduler::Scheduler(size_t quantum) :
+			m_quantum(quantum > 0 ? quantum : 1)
+		{
+		}
+
+		size_t Scheduler::add(BF_Machine& machine, unsigned int priority, size_t tickBudget)
+		{
+			Task _task;
+			_task.machine = &machine;
+			_task.slice = m_quantum * (priority > 0 ? priority : 1);
+			_task.budget = tickBudget;
+			_task.used = 0;
+			_task.state = tickBudget > 0 ? TaskState::READY : TaskState::OUT_OF_BUDGET;
+
+			m_tasks.push_back(_task);
+			if(_task.state == TaskState::READY)
+				m_ready.push_back(m_tasks.size() - 1);
+			return m_tasks.size() - 1;
+		}
+
+		void Scheduler::wake(size_t task)
+		{
+			if(m_tasks[task].state != TaskState::WAITING)
+				return;
+			m_tasks[task].state = TaskState::READY;
+			m_ready.push_back(task);
+		}
+
+		bool Scheduler::runRound()
+		{
+			if(m_ready.empty())
+				return false;
+
+			/* Tasks that stay ready are compacted to the front in the same order. Tasks woken
+			* during the round are appended past the end and keep their place. */
+			const size_t _count = m_ready.size();
+			size_t _kept = 0;
+			for(size_t i = 0; i < _count; i++)
+			{
+				const size_t _index = m_ready[i];
+				Task& _task = m_tasks[_index];
+
+				RunLimits _limits;
+				_limits.maxTicks = _task.slice < _task.budget ? _task.slice : _task.budget;
+				const RunResult _result = _task.machine->runBatch(_limits);
+
+				_task.used += _result.ticks;
+				_task.budget -= _result.ticks;
+
+				switch(_result.reason)
+				{
+					case StopReason::HALTED:
+						_task.state = TaskState::HALTED;
+						break;
+					case StopReason::TAPE_FAULT:
+						_task.state = TaskState::FAULTED;
+						break;
+					case StopReason::INPUT_NEEDED:
+					case StopReason::OUTPUT_FULL:
+						_task.state = TaskState::WAITING;
+						break;
+					default:
+						if(_task.budget == 0)
+							_task.state = TaskState::OUT_OF_BUDGET;
+						break;
+				}
+
+				if(_task.state == TaskState::READY)
+					m_ready[_kept++] = _index;
+			}
+
+			m_ready.erase(m_ready.begin() + _kept, m_ready.begin() + _count);
+			return true;
+		}
+
+		void Scheduler::run()
+		{
+			while(runRound())
+				;
+		}
+
+		const TaskState Scheduler::getState(size_t task) const
+		{
+			return m_tasks[task].state;
+		}
+
+		const size_t Scheduler::getTicksUsed(size_t task) const
+		{
+			return m_tasks[task].used;
+		}
+
+		const size_t Scheduler::getTaskCount() const
+		{
+			return m_tasks.size();
+		}
+
+		const size_t Scheduler::getReadyCount() const
+		{
+			return m_ready.size();
+		}
+
+		/******************************************************************************/
+		const char* taskStateToStr(TaskState state)
+		{
+			switch(state)
+			{
+				case TaskState::READY: return "Ready";
+				case TaskState::WAITING: return "Waiting";
+				case TaskState::HALTED: return "Halted";
+				case TaskState::FAULTED: return "Faulted";
+				case TaskState::OUT_OF_BUDGET: return "Out of budget";
+				default: return "UNKNOWN";
+			}
+		}
+	}
+}
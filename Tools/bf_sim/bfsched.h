@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include "bfsim.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		enum class TaskState
+		{
+			READY,			// Gets a slice every round
+			WAITING,		// Stopped on I/O, out of the rotation until wake()
+			HALTED,			// Program ended
+			FAULTED,		// Machine faulted on the tape edge
+			OUT_OF_BUDGET,	// Used up its tick budget before ending
+		};
+
+		/* Round-robins many machines on the calling thread. Each turn is one runBatch() of
+		* quantum * priority ticks, so a slice costs a call and a few compares on top of the ticks
+		* it runs. A task that stops on I/O leaves the rotation until wake(), one that runs through
+		* its tick budget is stopped for good. JIT and NATIVE don't count ticks: they can't be
+		* preempted and run until they end or stop on I/O, use an interpreted engine for programs
+		* that might not end. Machines aren't owned and must outlive their tasks. */
+		class Scheduler
+		{
+		public:
+
+			explicit Scheduler(size_t quantum = 4096);
+
+			/* Machine must be loaded and RUNNING. Returns the task's index */
+			size_t add(BF_Machine& machine, unsigned int priority = 1, size_t tickBudget = (size_t)-1);
+
+			/* Puts a WAITING task back in the rotation, e.g. after feeding it input */
+			void wake(size_t task);
+
+			/* One turn for every ready task, in the order they were added or woken. Returns
+			* false if no task was ready */
+			bool runRound();
+
+			/* Rounds until no task is ready */
+			void run();
+
+			const TaskState getState(size_t task) const;
+			const size_t getTicksUsed(size_t task) const;
+			const size_t getTaskCount() const;
+			const size_t getReadyCount() const;
+
+		private:
+
+			struct Task
+			{
+				BF_Machine* machine;
+				size_t slice;		// quantum * priority
+				size_t budget;		// Ticks left
+				size_t used;
+				TaskState state;
+			};
+
+		private:
+
+			size_t m_quantum;
+			std::vector<Task> m_tasks;
+			std::vector<size_t> m_ready;	// Rotation order
+		};
+
+		/******************************************************************************/
+		const char* taskStateToStr(TaskState state);
+	}
+}
@@ -2,6 +2,8 @@
 
 #include <iostream>
 
+#include "bfscan.h"
+
 
 namespace p95
 {
@@ -12,36 +14,119 @@ namespace p95
 			m_config = config;
 			
 			m_state = MachineState::READY;
+			m_ticks = 0;
 			m_sourceBuffer.reserve(MAX_PROG_SOURCE_LEN);
 			m_dataMemoryPtr = 0;
 			m_instructionPtr = 0;
-			m_dataMemory = std::vector<char>(m_config->maxDataMemorySize, (char)0);
-			m_progMem = std::string();
-			m_stdIn = std::string();
-			m_stdOut = std::string();
-			m_stdIn.reserve(MAX_STD_IN_SIZE + 1);
-			m_stdOut.reserve(MAX_STD_OUT_SIZE);
+			m_pc = 0;
+			m_program = Program::empty();
+			m_engine = m_program->getEngine();
+			m_hotLoop = false;
+			clearDataMemory();
+			m_stdIn.reset(MAX_STD_IN_SIZE);
+			m_stdOut.reset(MAX_STD_OUT_SIZE);
+			m_input = nullptr;
+			m_output = nullptr;
+			m_inputEnded = false;
+			m_lineBuffered = false;
 
 			m_currentInstruction = (char)0;
+			m_runLimits = nullptr;
+			m_ioStop = StopReason::TICK_LIMIT;
 		}
 
-		void BF_Machine::parseSource(const std::string& source)
+		bool BF_Machine::parseSource(const std::string& source)
 		{ 
-			const std::string _SYNTAX = "><+-.,[]";
+			std::shared_ptr<const Program> _program = Program::build(source, m_config->engine, m_config->dialect, m_config->prefixTicks, (size_t)m_config->maxDataMemorySize);
+			if(!_program)
+			{
+				loadProgram(Program::empty());
+				return false;
+			}
 
-			m_progMem = source;
-			m_progMem.erase(std::remove_if(m_progMem.begin(), m_progMem.end(), [&_SYNTAX](const char& c) {
-				return _SYNTAX.find(c) == std::string::npos;
-			}), m_progMem.end());
+			loadProgram(_program);
+			return true;
+		}
 
-			m_currentInstruction = m_progMem[m_instructionPtr];
+		void BF_Machine::loadProgram(const std::shared_ptr<const Program>& program)
+		{
+			/* A tape laid out for other cells or another edge policy starts over, and so does a
+			* used one: its ops are built for a run from a zeroed tape, see optimizeRanges() */
+			const Dialect& _old = m_program->getDialect();
+			const Dialect& _new = program->getDialect();
+			const bool _relayout = _old.cellBits != _new.cellBits || (_old.edge == TapeEdge::GROW) != (_new.edge == TapeEdge::GROW);
+
+			m_program = program;
+			m_engine = m_program->getEngine();
+			m_pc = 0;
+			m_instructionPtr = 0;
+			m_currentInstruction = m_program->getProgMem().empty() ? (char)0 : m_program->getProgMem()[0];
+			if(_relayout || !m_tapeClean)
+				clearDataMemory();
+			else
+				bindThreaded();
+			fitProgram();
+			applyPrefix();
 		}
 
 		void BF_Machine::writeToStdInBuffer(const std::string& val)
 		{
 			if(val.length() > MAX_STD_IN_SIZE)
 				return;
-			m_stdIn = val;
+			m_stdIn.clear();
+			m_stdIn.write(val.data(), val.length());
+		}
+
+		size_t BF_Machine::feedStdIn(const char* data, size_t size)
+		{
+			return m_stdIn.write(data, size);
+		}
+
+		void BF_Machine::closeStdIn()
+		{
+			m_inputEnded = true;
+		}
+
+		void BF_Machine::setInputSource(InputSource* source)
+		{
+			m_input = source;
+			m_inputEnded = false;
+		}
+
+		void BF_Machine::setOutputSink(OutputSink* sink)
+		{
+			m_output = sink;
+		}
+
+		void BF_Machine::setLineBuffered(bool enabled)
+		{
+			m_lineBuffered = enabled;
+		}
+
+		bool BF_Machine::flushStdOut()
+		{
+			if(m_output && !m_stdOut.empty())
+			{
+				/* Straight from the ring's storage, both halves in one go if it wraps */
+				const char* _first;
+				const char* _second;
+				size_t _firstSize, _secondSize;
+				m_stdOut.readable(&_first, &_firstSize, &_second, &_secondSize);
+				m_stdOut.consume(m_output->writeParts(_first, _firstSize, _second, _secondSize));
+			}
+			return !m_stdOut.full();
+		}
+
+		size_t BF_Machine::peekStdOut(const char** data) const
+		{
+			return m_stdOut.readable(data);
+		}
+
+		void BF_Machine::consumeStdOut(size_t size)
+		{
+			if(size > m_stdOut.size())
+				size = m_stdOut.size();
+			m_stdOut.consume(size);
 		}
 
 		void BF_Machine::setState(MachineState newState)
@@ -52,14 +137,102 @@ namespace p95
 		/******************************************************************************/
 		void BF_Machine::tick()
 		{
+			m_ioStop = StopReason::TICK_LIMIT;
+			m_tapeClean = false;
+
+			if(m_engine == Engine::THREADED || m_engine == Engine::TIERED)
+			{
+				runThreaded(1);
+				return;
+			}
+
+			if(m_engine == Engine::JIT)
+			{
+				runJit();
+				return;
+			}
+
+			if(m_engine == Engine::NATIVE)
+			{
+				runNative();
+				return;
+			}
+
+			if(m_engine == Engine::IR)
+			{
+				if(m_pc >= m_program->getOps().size())
+				{
+					m_state = MachineState::HALTED;
+					return;
+				}
+				executeOp();
+				if(!isIoBlocked())
+					m_ticks++;
+				syncInstructionPtr();
+				return;
+			}
+
 			if(m_instructionPtr >= getProgMemoSize())
 			{
 				m_state = MachineState::HALTED;
 				return;
 			}
 			executeInstruction();
-			m_ticks++;
-			m_currentInstruction = m_progMem[m_instructionPtr];
+			if(!isIoBlocked())
+				m_ticks++;
+			m_currentInstruction = m_program->getProgMem()[m_instructionPtr];
+		}
+
+		RunResult BF_Machine::runBatch(const RunLimits& limits)
+		{
+			if(m_state == MachineState::HALTED)
+				return { StopReason::HALTED, 0 };
+			if(m_state == MachineState::FAULTED)
+				return { StopReason::TAPE_FAULT, 0 };
+
+			m_runLimits = &limits;
+			m_tapeClean = false;
+			RunResult _result = (m_engine == Engine::JIT || m_engine == Engine::NATIVE) ? runCompiled(limits) : runInterpreted(limits);
+			m_runLimits = nullptr;
+
+			if(_result.reason == StopReason::HALTED)
+				flushStdOut();
+			return _result;
+		}
+
+		RunResult BF_Machine::runFor(size_t maxTicks)
+		{
+			RunLimits _limits;
+			_limits.maxTicks = maxTicks;
+			return runBatch(_limits);
+		}
+
+		RunResult BF_Machine::runUntilHalt()
+		{
+			return runBatch(RunLimits());
+		}
+
+		RunResult BF_Machine::runUntilOutput(size_t maxTicks)
+		{
+			RunLimits _limits;
+			_limits.maxTicks = maxTicks;
+			_limits.stopOnOutput = true;
+			return runBatch(_limits);
+		}
+
+		RunResult BF_Machine::runUntilInput(size_t maxTicks)
+		{
+			RunLimits _limits;
+			_limits.maxTicks = maxTicks;
+			_limits.stopOnInput = true;
+			return runBatch(_limits);
+		}
+
+		RunResult BF_Machine::runUntil(RunLimits::Clock::time_point deadline)
+		{
+			RunLimits _limits;
+			_limits.deadline = deadline;
+			return runBatch(_limits);
 		}
 
 		void BF_Machine::reset()
@@ -69,7 +242,9 @@ namespace p95
 
 			m_instructionPtr = 0;
 			m_currentInstruction = (char)0;
-			m_progMem = std::string();
+			m_program = Program::empty();
+			m_engine = m_program->getEngine();
+			m_pc = 0;
 
 			clearDataMemory();
 			clearIOBuffers();
@@ -77,34 +252,104 @@ namespace p95
 
 		void BF_Machine::clearDataMemory()
 		{
-			m_dataMemory = std::vector<char>(m_config->maxDataMemorySize, (char)0);
+			const Dialect& _dialect = m_program->getDialect();
+			const size_t _limit = (size_t)m_config->maxDataMemorySize;
+			size_t _cells = _limit;
+			if(_dialect.edge == TapeEdge::GROW && _cells > 1)
+				_cells = 1; // Where DP starts, the tape then holds just the cells the run reaches
+
+			/* In place, a reused machine keeps its tape allocation */
+			m_dataMemory.assign(_cells * _dialect.getCellSize(), (_dialect.edge == TapeEdge::GROW ? _limit : _cells) * _dialect.getCellSize(), m_config->guardedTape);
 			m_dataMemoryPtr = 0;
+			m_tapeClean = true;
+			bindThreaded();
 		}
 
-		void BF_Machine::clearIOBuffers()
+		void BF_Machine::resizeDataMemory()
 		{
-			m_stdIn = std::string();
-			m_stdOut = std::string();
+			const Dialect& _dialect = m_program->getDialect();
+			const size_t _limit = (size_t)m_config->maxDataMemorySize;
+			size_t _cells = _limit;
+			if(_dialect.edge == TapeEdge::GROW && getDataMemoSize() < _cells)
+				_cells = getDataMemoSize();
+
+			m_dataMemory.resize(_cells * getCellSize(), _limit * getCellSize());
+			if(m_dataMemoryPtr >= getDataMemoSize())
+				m_dataMemoryPtr = (unsigned int)getDataMemoSize() - 1;
+			bindThreaded();
+			if(m_tapeClean)
+				fitProgram();
 		}
 
-		void BF_Machine::executeInstruction()
+		bool BF_Machine::growDataMemory(long long cell)
 		{
-			static int _jumps = 0;
-			static std::vector<unsigned int> _jmpStack;
+			const size_t _size = getDataMemoSize();
+			if(cell >= 0 && (size_t)cell < _size)
+				return true;
+
+			/* The limit is on the span of cells reached, exactly what the tape holds. It keeps spare
+			* room of its own, so this stays cheap one cell at a time */
+			const size_t _needed = cell < 0 ? _size + (size_t)-cell : (size_t)cell + 1;
+			if(_needed > m_dataMemory.getLimit() / getCellSize())
+				return false;
+			return cell < 0 ? m_dataMemory.growFront(_needed * getCellSize()) : m_dataMemory.grow(_needed * getCellSize());
+		}
 
-			if(_jumps > 0)
-			{
-				if(m_currentInstruction == '[') _jumps++;
-				else if(m_currentInstruction == ']') _jumps--;
+		void BF_Machine::fitProgram()
+		{
+			/* Under CLAMP the ops only hold on a tape at least as long as the one they were built for */
+			if(m_program->getDialect().edge != TapeEdge::CLAMP || getDataMemoSize() >= m_program->getTapeCells())
+				return;
 
-				m_instructionPtr++;
+			m_program = m_program->rebuild(getDataMemoSize());
+			m_engine = m_program->getEngine();
+			bindThreaded();
+		}
+
+		void BF_Machine::applyPrefix()
+		{
+			/* Only where a run from the first op would start, and if it all fits */
+			const Prefix& _prefix = m_program->getPrefix();
+			if(_prefix.ticks == 0 || !m_tapeClean || _prefix.output.size() > m_stdOut.capacity() - m_stdOut.size())
 				return;
+			if(!_prefix.cells.empty() && !growDataMemory((long long)_prefix.cells.size() - 1))
+				return;
+
+			char* const _data = m_dataMemory.data();
+			for(size_t i = 0; i < _prefix.cells.size(); i++)
+			{
+				switch(getCellSize())
+				{
+					case 2: ((uint16_t*)_data)[i] = (uint16_t)_prefix.cells[i]; break;
+					case 4: ((uint32_t*)_data)[i] = (uint32_t)_prefix.cells[i]; break;
+					case 8: ((uint64_t*)_data)[i] = _prefix.cells[i]; break;
+					default: _data[i] = (char)_prefix.cells[i]; break;
+				}
 			}
+			m_stdOut.write(_prefix.output.data(), _prefix.output.size());
+
+			m_pc = _prefix.pc;
+			m_dataMemoryPtr = (unsigned int)_prefix.dp;
+			m_ticks += _prefix.ticks;
+			m_tapeClean = false;
+			syncInstructionPtr();
+		}
+
+		void BF_Machine::clearIOBuffers()
+		{
+			m_stdIn.clear();
+			m_stdOut.clear();
+			m_inputEnded = false;
+		}
+
+		void BF_Machine::executeInstruction()
+		{
+			const std::vector<unsigned int>& _jumpTable = m_program->getJumpTable();
 
 			switch(m_currentInstruction)
 			{
 				case '>':
-					if(m_dataMemoryPtr < getDataMemoCapacity()) m_dataMemoryPtr++;
+					if(m_dataMemoryPtr + 1 < getDataMemoSize()) m_dataMemoryPtr++;
 					break;
 
 				case '<':
@@ -120,42 +365,356 @@ namespace p95
 					break;
 
 				case '.':
-					if(m_stdOut.length() < MAX_STD_OUT_SIZE)
-						m_stdOut.push_back(m_dataMemory[m_dataMemoryPtr]);
+					if(!writeOutput(m_dataMemory[m_dataMemoryPtr]))
+						return; // Output full, retry this instruction
 					break;
 
 				case ',':
-					if(m_stdIn.length() > 0)
-					{
-						m_dataMemory[m_dataMemoryPtr] = m_stdIn[0];
-						m_stdIn.pop_back();
-					}
+				{
+					const int _byte = readInput();
+					if(_byte == INPUT_BLOCKED)
+						return; // No input yet, retry this instruction
+					if(_byte != INPUT_END)
+						m_dataMemory[m_dataMemoryPtr] = (char)_byte;
 					break;
+				}
 
 				case '[':
-					if(m_dataMemory[m_dataMemoryPtr] == 0) _jumps = 1;
-					else 
-						_jmpStack.push_back(m_instructionPtr);
-
+					if(m_dataMemory[m_dataMemoryPtr] == 0)
+						m_instructionPtr = _jumpTable[m_instructionPtr]; // Continue past matching "]"
 					break;
 
 				case ']':
 					if(m_dataMemory[m_dataMemoryPtr] != 0)
-					{
-						if(!_jmpStack.empty()) // TODO: Proper error message
-							m_instructionPtr = _jmpStack.back();
-						
+						m_instructionPtr = _jumpTable[m_instructionPtr]; // Continue past matching "["
+					break;
+			}
+			if(m_instructionPtr < getProgMemoSize())
+				m_instructionPtr++;
+		}
+
+		void BF_Machine::executeOp()
+		{
+			const Op& _op = m_program->getOps()[m_pc];
+
+			switch(_op.code)
+			{
+				case OpCode::ADD:
+					m_dataMemory[cellIndex(_op.offset)] += (char)_op.arg;
+					break;
+
+				case OpCode::MOVE:
+					m_dataMemoryPtr = cellIndex(_op.arg);
+					break;
+
+				case OpCode::OUT:
+					if(!writeOutput(m_dataMemory[cellIndex(_op.offset)]))
+						return;
+					break;
+
+				case OpCode::IN:
+				{
+					const int _byte = readInput();
+					if(_byte == INPUT_BLOCKED)
 						return;
+					if(_byte != INPUT_END)
+						m_dataMemory[cellIndex(_op.offset)] = (char)_byte;
+					break;
+				}
+
+				case OpCode::JZ:
+					if(m_dataMemory[m_dataMemoryPtr] == 0)
+						m_pc = _op.target;
+					break;
+
+				case OpCode::JNZ:
+					if(m_dataMemory[m_dataMemoryPtr] != 0)
+						m_pc = _op.target;
+					break;
+
+				case OpCode::CLEAR:
+					m_dataMemory[cellIndex(_op.offset)] = 0;
+					break;
+
+				case OpCode::MULADD:
+					m_dataMemory[cellIndex(_op.offset)] += (char)(m_dataMemory[cellIndex(_op.srcOffset)] * _op.arg);
+					break;
+
+				case OpCode::SCAN:
+				{
+					size_t _zero = scanZero(m_dataMemory.data(), getDataMemoSize(), m_dataMemoryPtr, _op.arg);
+					if(_zero == SCAN_NOT_FOUND)
+					{
+						/* Ran off data memory, moves clamp at the edge */
+						m_dataMemoryPtr = _op.arg > 0 ? (unsigned int)getDataMemoSize() - 1 : 0;
+						if(m_dataMemory[m_dataMemoryPtr] != 0)
+							return; // Stuck at the edge, spin here like the plain loop would
 					}
 					else
+						m_dataMemoryPtr = (unsigned int)_zero;
+					break;
+				}
+			}
+			m_pc++;
+		}
+
+		unsigned int BF_Machine::cellIndex(int offset) const
+		{
+			/* Clamp to data memory. Folded moves and offsets go one way, see optimizeOffsets(), so
+			* this is the cell stepping through them one by one would stop at */
+			long long _idx = (long long)m_dataMemoryPtr + offset;
+			if(_idx < 0) _idx = 0;
+			else if(_idx >= (long long)getDataMemoSize()) _idx = (long long)getDataMemoSize() - 1;
+			return (unsigned int)_idx;
+		}
+
+		size_t BF_Machine::runJit()
+		{
+			JitFrame _frame = makeFrame();
+			m_pc = m_program->getJit().run(_frame, m_pc);
+			m_dataMemoryPtr = (unsigned int)(_frame.cell - _frame.lo);
+
+			if(m_pc >= m_program->getOps().size())
+				m_state = MachineState::HALTED;
+			syncInstructionPtr();
+			return 0;
+		}
+
+		size_t BF_Machine::runNative()
+		{
+			JitFrame _frame = makeFrame();
+			m_pc = m_program->getNative().run(_frame, m_pc);
+			m_dataMemoryPtr = (unsigned int)(_frame.cell - _frame.lo);
+
+			if(m_pc >= m_program->getOps().size())
+				m_state = MachineState::HALTED;
+			syncInstructionPtr();
+			return 0;
+		}
+
+		JitFrame BF_Machine::makeFrame()
+		{
+			JitFrame _frame = {};
+			_frame.cell = m_dataMemory.data() + m_dataMemoryPtr;
+			_frame.lo = m_dataMemory.data();
+			_frame.hi = m_dataMemory.data() + m_dataMemory.size() - 1;
+			_frame.ctx = this;
+			_frame.put = &BF_Machine::framePut;
+			_frame.get = &BF_Machine::frameGet;
+			_frame.scan = &scanZero;
+			return _frame;
+		}
+
+		int BF_Machine::framePut(void* ctx, char value)
+		{
+			BF_Machine* _machine = (BF_Machine*)ctx;
+			const RunLimits* _limits = _machine->m_runLimits;
+			if(_limits && _limits->stopOnOutput)
+			{
+				_machine->m_ioStop = StopReason::OUTPUT;
+				return 1;
+			}
+			if(_limits && _limits->deadline != RunLimits::Clock::time_point::max() && RunLimits::Clock::now() >= _limits->deadline)
+			{
+				_machine->m_ioStop = StopReason::DEADLINE;
+				return 1;
+			}
+
+			return _machine->writeOutput(value) ? 0 : 1;
+		}
+
+		int BF_Machine::frameGet(void* ctx, char* cell)
+		{
+			BF_Machine* _machine = (BF_Machine*)ctx;
+			const RunLimits* _limits = _machine->m_runLimits;
+			if(_limits && _limits->deadline != RunLimits::Clock::time_point::max() && RunLimits::Clock::now() >= _limits->deadline)
+			{
+				_machine->m_ioStop = StopReason::DEADLINE;
+				return 1;
+			}
+
+			const int _byte = _machine->readInput();
+			if(_byte == INPUT_BLOCKED)
+				return 1;
+			if(_byte != INPUT_END)
+				*cell = (char)_byte;
+			return 0;
+		}
+
+		void BF_Machine::syncInstructionPtr()
+		{
+			const std::vector<Op>& _ops = m_program->getOps();
+			m_instructionPtr = m_pc < _ops.size() ? _ops[m_pc].instrIdx : (unsigned int)getProgMemoSize();
+			m_currentInstruction = m_program->getProgMem()[m_instructionPtr];
+		}
+
+		bool BF_Machine::writeOutput(char value)
+		{
+			if(m_stdOut.full() && !flushStdOut())
+			{
+				m_ioStop = StopReason::OUTPUT_FULL;
+				return false;
+			}
+
+			m_stdOut.push(value);
+			if(m_lineBuffered && value == '\n')
+				flushStdOut();
+			if(m_runLimits && m_runLimits->stopOnOutput)
+				m_ioStop = StopReason::OUTPUT;
+			return true;
+		}
+
+		int BF_Machine::readInput()
+		{
+			if(m_stdIn.empty() && m_input && !m_inputEnded)
+			{
+				flushStdOut(); // Prompts show up before the source blocks
+
+				char* _dst;
+				const size_t _free = m_stdIn.writable(&_dst);
+				long _read = m_input->read(_dst, _free);
+				if(_read > 0)
+					m_stdIn.commit((size_t)_read);
+				else if(_read == InputSource::END)
+					m_inputEnded = true;
+			}
+
+			if(m_stdIn.empty())
+			{
+				/* Without a source an empty buffer reads like end of input */
+				const bool _waiting = m_input && !m_inputEnded;
+				if(_waiting || (m_runLimits && m_runLimits->stopOnInput && !m_inputEnded))
+				{
+					m_ioStop = StopReason::INPUT_NEEDED;
+					return INPUT_BLOCKED;
+				}
+				return INPUT_END;
+			}
+
+			return (unsigned char)m_stdIn.pop();
+		}
+
+		const bool BF_Machine::isIoBlocked() const
+		{
+			return m_ioStop == StopReason::INPUT_NEEDED || m_ioStop == StopReason::OUTPUT_FULL;
+		}
+
+		RunResult BF_Machine::runInterpreted(const RunLimits& limits)
+		{
+			/* Reading the clock every tick would cost more than the tick, check it once per slice */
+			static const size_t DEADLINE_SLICE = 4096;
+
+			const bool _hasDeadline = limits.deadline != RunLimits::Clock::time_point::max();
+			const size_t _startTicks = m_ticks;
+			RunResult _result = { StopReason::TICK_LIMIT, 0 };
+
+			while(true)
+			{
+				const size_t _ran = m_ticks - _startTicks;
+				if(m_state == MachineState::HALTED)
+				{
+					_result.reason = StopReason::HALTED;
+					break;
+				}
+				if(m_state == MachineState::FAULTED)
+				{
+					_result.reason = StopReason::TAPE_FAULT;
+					break;
+				}
+				if(_ran >= limits.maxTicks)
+					break;
+				if(_hasDeadline && RunLimits::Clock::now() >= limits.deadline)
+				{
+					_result.reason = StopReason::DEADLINE;
+					break;
+				}
+
+				size_t _slice = limits.maxTicks - _ran;
+				if(_hasDeadline && _slice > DEADLINE_SLICE)
+					_slice = DEADLINE_SLICE;
+
+				if(m_engine == Engine::THREADED || m_engine == Engine::TIERED)
+				{
+					m_ioStop = StopReason::TICK_LIMIT;
+					runThreaded(_slice);
+					if(m_hotLoop)
+					{
+						/* The rest of the run is compiled, its ticks aren't counted */
+						m_hotLoop = false;
+						if(tierUp())
+						{
+							_result.reason = runCompiled(limits).reason;
+							break;
+						}
+						continue;
+					}
+					if(m_ioStop != StopReason::TICK_LIMIT)
+					{
+						_result.reason = m_ioStop;
+						break;
+					}
+					continue;
+				}
+
+				const size_t _sliceStart = m_ticks;
+				while(m_state != MachineState::HALTED && m_ticks - _sliceStart < _slice)
+				{
+					tick();
+					if(m_ioStop != StopReason::TICK_LIMIT)
 					{
-						if(!_jmpStack.empty()) // TODO: Proper error message
-							_jmpStack.pop_back();
+						_result.reason = m_ioStop;
+						break;
 					}
+				}
+				if(_result.reason != StopReason::TICK_LIMIT)
 					break;
 			}
-			if(m_instructionPtr < getProgMemoSize())
-				m_instructionPtr++;
+			_result.ticks = m_ticks - _startTicks;
+			return _result;
+		}
+
+		RunResult BF_Machine::runCompiled(const RunLimits& limits)
+		{
+			const bool _hasDeadline = limits.deadline != RunLimits::Clock::time_point::max();
+			const bool _bounded = _hasDeadline || limits.maxTicks != (size_t)-1;
+
+			while(true)
+			{
+				if(_hasDeadline && RunLimits::Clock::now() >= limits.deadline)
+					return { StopReason::DEADLINE, 0 };
+
+				m_ioStop = StopReason::TICK_LIMIT;
+				if(m_engine == Engine::JIT)
+					runJit();
+				else
+					runNative();
+
+				if(m_state == MachineState::HALTED)
+					return { StopReason::HALTED, 0 };
+
+				if(m_ioStop == StopReason::OUTPUT)
+				{
+					/* put() suspends before the op, finish it here so the output is produced exactly once */
+					m_ioStop = StopReason::TICK_LIMIT;
+					executeOp();
+					syncInstructionPtr();
+					return { m_ioStop, 0 };
+				}
+				if(m_ioStop != StopReason::TICK_LIMIT)
+					return { m_ioStop, 0 };
+
+				/* Suspended at a scan stuck at the tape edge, it would spin forever */
+				if(_bounded)
+					return { StopReason::TICK_LIMIT, 0 };
+			}
+		}
+
+		bool BF_Machine::tierUp()
+		{
+			/* A program the JIT can't take stays interpreted, and stops counting */
+			m_engine = m_program->compileTiered() ? Engine::JIT : Engine::THREADED;
+			bindThreaded();
+			return m_engine == Engine::JIT;
 		}
 
 		/******************************************************************************/
@@ -171,17 +730,22 @@ namespace p95
 
 		const size_t BF_Machine::getProgMemoSize() const
 		{
-			return m_progMem.length();
+			return m_program->getProgMem().length();
 		}
 
 		const size_t BF_Machine::getDataMemoSize() const
 		{
-			return m_dataMemory.size();
+			return m_dataMemory.size() / getCellSize();
 		}
 
 		const size_t BF_Machine::getDataMemoCapacity() const
 		{
-			return m_dataMemory.capacity();
+			return m_dataMemory.capacity() / getCellSize();
+		}
+
+		const size_t BF_Machine::getCellSize() const
+		{
+			return m_program->getDialect().getCellSize();
 		}
 
 		const unsigned int BF_Machine::getDataPtr() const
@@ -194,24 +758,24 @@ namespace p95
 			return m_instructionPtr;
 		}
 
-		const std::string& BF_Machine::getStdIn() const
+		std::string BF_Machine::getStdIn() const
 		{
-			return m_stdIn;
+			return m_stdIn.str();
 		}
 
-		const std::string& BF_Machine::getStdOut() const
+		std::string BF_Machine::getStdOut() const
 		{
-			return m_stdOut;
+			return m_stdOut.str();
 		}
 
 		const size_t BF_Machine::getStdInSize() const
 		{
-			return m_stdIn.length();
+			return m_stdIn.size();
 		}
 
 		const size_t BF_Machine::getStdOutSize() const
 		{
-			return m_stdOut.length();
+			return m_stdOut.size();
 		}
 
 		const char* BF_Machine::getDataMemory() const
@@ -221,7 +785,7 @@ namespace p95
 
 		const char* BF_Machine::getProgMemory() const
 		{
-			return m_progMem.c_str();
+			return m_program->getProgMem().c_str();
 		}
 
 		const char BF_Machine::getCurrentInstruction() const
@@ -229,6 +793,21 @@ namespace p95
 			return m_currentInstruction;
 		}
 
+		const Engine BF_Machine::getEngine() const
+		{
+			return m_engine;
+		}
+
+		const size_t BF_Machine::getIRSize() const
+		{
+			return m_program->getOps().size();
+		}
+
+		const std::shared_ptr<const Program>& BF_Machine::getProgram() const
+		{
+			return m_program;
+		}
+
 		/******************************************************************************/
 		const char* stateToStr(MachineState state)
 		{
@@ -237,6 +816,36 @@ namespace p95
 				case MachineState::READY: return "READY";
 				case MachineState::RUNNING: return "RUNNING";
 				case MachineState::HALTED: return "HALT";
+				case MachineState::FAULTED: return "FAULT";
+				default: return "UNKNOWN";
+			}
+		}
+
+		const char* engineToStr(Engine engine)
+		{
+			switch(engine)
+			{
+				case Engine::STEPPING: return "Stepping";
+				case Engine::IR: return "IR";
+				case Engine::THREADED: return "Threaded";
+				case Engine::JIT: return "JIT";
+				case Engine::NATIVE: return "Native C";
+				case Engine::TIERED: return "Tiered";
+				default: return "UNKNOWN";
+			}
+		}
+
+		const char* stopReasonToStr(StopReason reason)
+		{
+			switch(reason)
+			{
+				case StopReason::HALTED: return "Halted";
+				case StopReason::TICK_LIMIT: return "Tick limit";
+				case StopReason::OUTPUT: return "Output";
+				case StopReason::INPUT_NEEDED: return "Input needed";
+				case StopReason::OUTPUT_FULL: return "Output full";
+				case StopReason::DEADLINE: return "Deadline";
+				case StopReason::TAPE_FAULT: return "Tape fault";
 				default: return "UNKNOWN";
 			}
 		}
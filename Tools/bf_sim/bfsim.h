@@ -1,8 +1,14 @@
 #pragma once
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "bfio.h"
+#include "bfprogram.h"
+#include "bftape.h"
+
 
 
 namespace p95
@@ -11,10 +17,14 @@ namespace p95
 	{
 		struct SimConfig
 		{
+			Engine engine;
 			int intructionsPerSec;
 			size_t ticks;
-			int maxDataMemorySize;
+			int maxDataMemorySize;	// Tape size in cells, the ceiling when the dialect grows the tape
 			int maxProgramMemorySize;
+			Dialect dialect;		// What parseSource() builds for
+			bool guardedTape = false;	// Tape between guard pages where available, THREADED then skips most edge checks under ERROR when the tape is whole pages
+			size_t prefixTicks = 0;		// Ops parseSource() runs ahead of the first input, see Program::getPrefix()
 
 			// Some constants
 			static const int MAX_INSTR_PER_SEC = 50;
@@ -25,8 +35,43 @@ namespace p95
 			READY,
 			RUNNING,
 			HALTED,
+			FAULTED,	// Went past the tape under TapeEdge::ERROR or the growth limit, reset() to run again
+		};
+
+		enum class StopReason
+		{
+			HALTED,			// Program ended
+			TICK_LIMIT,		// Ran the requested number of ticks
+			OUTPUT,			// An output instruction just ran
+			INPUT_NEEDED,	// Next instruction reads input but none is buffered or available from the source, it hasn't run yet
+			OUTPUT_FULL,	// Next instruction writes output but the buffer is full and the sink takes no more, it hasn't run yet
+			DEADLINE,		// Wall-clock deadline passed
+			TAPE_FAULT,		// Machine faulted, see MachineState::FAULTED
+		};
+
+		/* Stop conditions of a batch run. Defaults run until the program ends */
+		struct RunLimits
+		{
+			typedef std::chrono::steady_clock Clock;
+
+			size_t maxTicks = (size_t)-1;
+			bool stopOnOutput = false;
+			bool stopOnInput = false;
+			Clock::time_point deadline = Clock::time_point::max();
+		};
+
+		struct RunResult
+		{
+			StopReason reason;
+			size_t ticks;	// Ticks run by this call, always 0 for JIT and NATIVE
 		};
 
+		/* Thread-safety: a machine isn't synchronised, use each instance from one thread at a time.
+		* All execution state (DP, IP, tape, IO buffers, decoded code) is owned by the instance, so
+		* separate machines can run concurrently. A loaded Program is immutable and can be shared
+		* between machines on any thread. The SimConfig is only read in init(), parseSource() and
+		* the memory clearing calls and must outlive the machine. Attached I/O sources and sinks are
+		* called on the thread running the machine. */
 		class BF_Machine
 		{
 		public:
@@ -34,59 +79,154 @@ namespace p95
 			BF_Machine() = default;
 
 			void init(SimConfig* config);
-			void parseSource(const std::string& source);
+			bool parseSource(const std::string& source);
+			void loadProgram(const std::shared_ptr<const Program>& program);
 			void writeToStdInBuffer(const std::string& val);
+
+			/* Appends to pending input, returns how much fit. After closeStdIn() an empty buffer
+			* reads as end of input even in runs that stop on input. */
+			size_t feedStdIn(const char* data, size_t size);
+			void closeStdIn();
+
+			/* Not owned, nullptr detaches. Without a source an empty stdin buffer reads as end of input
+			* (the dialect's EofMode says what the cell gets), without a sink output waits in the stdout buffer. */
+			void setInputSource(InputSource* source);
+			void setOutputSink(OutputSink* sink);
+
+			/* Output reaches the sink when the stdout buffer fills, when input is read, when a batch
+			* run halts and on flushStdOut(). Line buffering also flushes after every newline. */
+			void setLineBuffered(bool enabled);
+
+			/* Moves buffered output into the sink, returns false if the buffer is still full */
+			bool flushStdOut();
+
+			/* Zero-copy alternative to a sink: the oldest contiguous run of buffered output, valid
+			* until the machine runs again, then release what was used */
+			size_t peekStdOut(const char** data) const;
+			void consumeStdOut(size_t size);
 			void setState(MachineState newState);
 			
 			void tick();
+
+			/* Batch execution, without the per-call overhead of tick(). JIT and NATIVE don't count
+			* ticks, they stop only at I/O, at the end or, if the run is bounded, at a stuck scan.
+			* They check the deadline only when they return to the host on I/O. Output is flushed
+			* to the sink when the run halts, not on other stops.
+			*
+			* TIERED interprets and counts ticks until a loop has taken TIER_UP_BACK_EDGES
+			* back-edges, then carries on as JIT from that loop's head. Only unbounded runs (no tick
+			* limit, no deadline) switch, JIT code can't be stopped part-way. */
+			RunResult runBatch(const RunLimits& limits);
+			RunResult runFor(size_t maxTicks);
+			RunResult runUntilHalt();
+			RunResult runUntilOutput(size_t maxTicks = (size_t)-1);
+			RunResult runUntilInput(size_t maxTicks = (size_t)-1);
+			RunResult runUntil(RunLimits::Clock::time_point deadline);
+
 			void reset();
 			void clearDataMemory();
+			/* Applies a changed maxDataMemorySize, keeps the tape's contents. A CLAMP tape cut below
+			* what the loaded program was built for gets the program rebuilt if it hasn't run yet,
+			* see Program::build(). A run under way keeps its ops. */
+			void resizeDataMemory();
 			void clearIOBuffers();
 			void executeInstruction();
+			void executeOp();
 
 			const MachineState getState() const;
 			const size_t getTicks() const;
 			const size_t getProgMemoSize() const;
-			const size_t getDataMemoSize() const;
-			const size_t getDataMemoCapacity() const;
+			const size_t getDataMemoSize() const;		// In cells
+			const size_t getDataMemoCapacity() const;	// In cells
+			const size_t getCellSize() const;			// Bytes per cell, getDataMemory() holds cells of this size
 			const unsigned int getDataPtr() const;
 			const unsigned int getInstructionPtr() const;
-			const std::string& getStdIn() const;
-			const std::string& getStdOut() const;
+			std::string getStdIn() const;
+			std::string getStdOut() const;
 			const size_t getStdInSize() const;
 			const size_t getStdOutSize() const;
 			const char* getDataMemory() const;
 			const char* getProgMemory() const;
 			const char getCurrentInstruction() const;
+			const Engine getEngine() const;
+			const size_t getIRSize() const;
+			const std::shared_ptr<const Program>& getProgram() const;
 			
 
 
 		public:
 
-			static const size_t MAX_STD_IN_SIZE = 32;
-			static const size_t MAX_STD_OUT_SIZE = 32;
+			static const size_t MAX_STD_IN_SIZE = 4096;
+			static const size_t MAX_STD_OUT_SIZE = 65536;
 			static const size_t MAX_PROG_SOURCE_LEN = 10240;
+			static const unsigned int TIER_UP_BACK_EDGES = 1000;	// Taken "]" of one loop before TIERED compiles
 			
 			std::string m_sourceBuffer;
 
 			
 		private:
 
+			unsigned int cellIndex(int offset) const;
+			void syncInstructionPtr();
+			bool writeOutput(char value);
+			int readInput();
+			bool growDataMemory(long long cell);	// Until "cell" is on the tape, which moves every cell back if it's negative
+			void applyPrefix();
+			void fitProgram();	// Rebuilds the program for a CLAMP tape shorter than it was built for
+			const bool isIoBlocked() const;
+			RunResult runInterpreted(const RunLimits& limits);
+			RunResult runCompiled(const RunLimits& limits);
+			bool tierUp();
+			size_t runThreaded(size_t maxTicks);
+			template<class Cell, Overflow O, EofMode E, TapeEdge T, bool G, bool H> size_t runThreadedAs(size_t maxTicks);
+			size_t runJit();
+			size_t runNative();
+			JitFrame makeFrame();
+
+			static int framePut(void* ctx, char value);
+			static int frameGet(void* ctx, char* cell);
+
+			/* The threaded interpreter built for a dialect, one instantiation per combination. The
+			* unchecked ones (ERROR only) leave accesses past the tape to the guard pages, the counting one
+			* (classic dialect only) looks for hot loops for TIERED */
+			typedef size_t (BF_Machine::*ThreadedRun)(size_t maxTicks);
+			static ThreadedRun selectThreaded(const Dialect& dialect, bool unchecked, bool counting);
+			void bindThreaded();
+
+		private:
+
+			static const int INPUT_END = -1;		// readInput(): end of input
+			static const int INPUT_BLOCKED = -2;	// readInput(): nothing to read yet, the instruction waits
+
 			SimConfig* m_config;
 
 			MachineState m_state;
 			size_t m_ticks;
 			unsigned char m_currentInstruction;
-			std::string m_progMem;
-			std::vector<char> m_dataMemory;
+			std::shared_ptr<const Program> m_program;
+			ThreadedRun m_runThreaded;	// Instantiation for the loaded program's dialect and the tape
+			unsigned int m_pc; // Index of the next IR op
+			Engine m_engine;	// The program's, JIT once a TIERED run has switched
+			std::vector<unsigned int> m_backEdges;	// TIERED: back-edges taken per "]" op
+			bool m_hotLoop;		// TIERED: the threaded run stopped at the head of a hot loop
+			Tape m_dataMemory;
+			bool m_tapeClean;	// Zeroed with DP on the first cell and nothing run since, a loaded program may skip its prefix
 			unsigned int m_dataMemoryPtr;
 			unsigned int m_instructionPtr;
-			std::string m_stdIn;
-			std::string m_stdOut;
+			RingBuffer m_stdIn;
+			RingBuffer m_stdOut;
+			InputSource* m_input;
+			OutputSink* m_output;
+			bool m_inputEnded;	// Source reported end of input, or closeStdIn()
+			bool m_lineBuffered;
+			const RunLimits* m_runLimits;	// Limits of the batch run in progress, nullptr otherwise
+			StopReason m_ioStop;			// Why an I/O handler ended the batch run, TICK_LIMIT if none did
 
 		};
 
 		/******************************************************************************/
 		const char* stateToStr(MachineState state);
+		const char* engineToStr(Engine engine);
+		const char* stopReasonToStr(StopReason reason);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,437 @@
+#include "bftape.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* Plain tapes grow with mremap, so pages move without copying, and big ones are cleared by
+* dropping their pages. MADV_DONTNEED zeroes anonymous pages here, elsewhere it doesn't have to */
+#if defined(__linux__)
+	#define BF_LINUX_MM
+#endif
+
+#if defined(BF_GUARDED_TAPE_AVAILABLE)
+	#include <setjmp.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+
+	#include <mutex>
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+#if defined(BF_GUARDED_TAPE_AVAILABLE)
+		namespace
+		{
+			size_t pageSize()
+			{
+				static const size_t _page = (size_t)sysconf(_SC_PAGESIZE);
+				return _page;
+			}
+
+			size_t roundToPages(size_t size)
+			{
+				if(size == 0)
+					size = 1;
+				return (size + pageSize() - 1) / pageSize() * pageSize();
+			}
+		}
+
+		/* The guarded call in progress on a thread. Faults are synchronous, so the handler runs on
+		* the thread that faulted and finds its own call here. */
+		struct GuardFault
+		{
+			Tape* tape;
+			GuardFault* outer;
+			sigjmp_buf jump;
+
+			static thread_local GuardFault* s_current;
+			static struct sigaction s_previous[2];	// SIGSEGV, SIGBUS
+
+			static void install()
+			{
+				static std::once_flag _once;
+				std::call_once(_once, []() {
+					struct sigaction _action = {};
+					_action.sa_sigaction = &GuardFault::handle;
+					_action.sa_flags = SA_SIGINFO | SA_NODEFER; // Not blocked after jumping out of the handler
+					sigemptyset(&_action.sa_mask);
+					sigaction(SIGSEGV, &_action, &s_previous[0]);
+					sigaction(SIGBUS, &_action, &s_previous[1]); // What macOS raises for PROT_NONE
+				});
+			}
+
+			static void handle(int signal, siginfo_t* info, void* context)
+			{
+				GuardFault* _fault = s_current;
+				char* _address = (char*)info->si_addr;
+				if(_fault && _address >= _fault->tape->m_region && _address < _fault->tape->m_region + _fault->tape->m_regionSize)
+				{
+					siglongjmp(_fault->jump, 1);
+				}
+
+				/* Not a tape access, whoever handled it before us gets it */
+				const struct sigaction& _previous = s_previous[signal == SIGSEGV ? 0 : 1];
+				if(_previous.sa_flags & SA_SIGINFO)
+					_previous.sa_sigaction(signal, info, context);
+				else if(_previous.sa_handler != SIG_DFL && _previous.sa_handler != SIG_IGN)
+					_previous.sa_handler(signal);
+				else
+					sigaction(signal, &_previous, nullptr); // Faults again on return and takes the default action
+			}
+		};
+
+		thread_local GuardFault* GuardFault::s_current = nullptr;
+		struct sigaction GuardFault::s_previous[2];
+#endif
+
+		/******************************************************************************/
+		Tape::Tape() :
+			m_data(nullptr),
+			m_size(0),
+			m_limit(0),
+			m_shift(0),
+			m_block(nullptr),
+			m_blockSize(0),
+			m_region(nullptr),
+			m_regionSize(0),
+			m_reserved(0),
+			m_mapped(nullptr),
+			m_mappedSize(0)
+		{
+		}
+
+		Tape::~Tape()
+		{
+			release();
+		}
+
+		void Tape::assign(size_t size, size_t limit, bool guarded)
+		{
+			if(limit < size)
+				limit = size;
+			m_shift = 0;
+
+#if defined(BF_GUARDED_TAPE_AVAILABLE)
+			if(guarded)
+			{
+				/* The reservation is whole pages, the tape itself keeps its size */
+				const size_t _reserved = roundToPages(limit);
+
+				if(m_region && m_reserved == _reserved)
+				{
+					/* Same reservation, zero it and hand back the pages outside the new tape. The tape
+					* always covers where it started, so what stays accessible is one piece */
+					char* const _start = m_region + GUARD_SIZE + _reserved;
+					char* const _end = _start + roundToPages(size);
+					char* const _mappedEnd = m_mapped + m_mappedSize;
+					zero(m_data, m_size);
+					if(m_mapped < _start)
+					{
+						madvise(m_mapped, (size_t)(_start - m_mapped), MADV_DONTNEED);
+						mprotect(m_mapped, (size_t)(_start - m_mapped), PROT_NONE);
+					}
+					if(_mappedEnd > _end)
+					{
+						madvise(_end, (size_t)(_mappedEnd - _end), MADV_DONTNEED);
+						mprotect(_end, (size_t)(_mappedEnd - _end), PROT_NONE);
+					}
+					m_mapped = _start;
+					m_mappedSize = (size_t)((_mappedEnd < _end ? _mappedEnd : _end) - _start);
+					m_data = _start;
+					m_size = 0;
+					m_limit = limit;
+					commit(size, false);
+					return;
+				}
+
+				/* Room for the whole limit on either side, the tape starts in the middle */
+				release();
+				const size_t _regionSize = 2 * (_reserved + GUARD_SIZE);
+				void* _region = mmap(nullptr, _regionSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if(_region != MAP_FAILED)
+				{
+					GuardFault::install();
+					m_region = (char*)_region;
+					m_regionSize = _regionSize;
+					m_data = m_region + GUARD_SIZE + _reserved;
+					m_size = 0;
+					m_limit = limit;
+					m_reserved = _reserved;
+					m_mapped = m_data;
+					m_mappedSize = 0;
+					if(commit(size, false))
+						return;
+				}
+				release();
+			}
+#endif
+
+			/* In place, a reused plain tape keeps its allocation */
+			if(m_region)
+				release();
+			if(m_block)
+				zero(m_data, m_size);
+			reallocate(size);
+			m_data = m_block;
+			m_size = size;
+			m_limit = limit;
+		}
+
+		void Tape::resize(size_t size, size_t limit)
+		{
+			if(limit < size)
+				limit = size;
+
+			if(m_region)
+			{
+				/* The reservation depends on the limit, so start a new one and copy over */
+				const std::vector<char> _contents(m_data, m_data + (size < m_size ? size : m_size));
+				assign(size, limit, true);
+				memcpy(m_data, _contents.data(), _contents.size());
+				return;
+			}
+
+			if(size < m_size)
+			{
+				/* Back to the start of the block, which then shrinks to fit */
+				memmove(m_block, m_data, size);
+				memset(m_block + size, 0, (size_t)(m_data + m_size - m_block) - size);
+				m_data = m_block;
+				m_size = size;
+				reallocate(size);
+			}
+			m_limit = limit;
+			grow(size);
+		}
+
+		bool Tape::grow(size_t size)
+		{
+			if(size <= m_size)
+				return true;
+			if(size > m_limit)
+				return false;
+			return commit(size, false);
+		}
+
+		bool Tape::growFront(size_t size)
+		{
+			if(size <= m_size)
+				return true;
+			if(size > m_limit)
+				return false;
+			return commit(size, true);
+		}
+
+		const size_t Tape::size() const
+		{
+			return m_size;
+		}
+
+		const size_t Tape::capacity() const
+		{
+			return m_region ? m_limit : m_blockSize - (size_t)(m_data - m_block);
+		}
+
+		const size_t Tape::getLimit() const
+		{
+			return m_limit;
+		}
+
+		const size_t Tape::getShift() const
+		{
+			return m_shift;
+		}
+
+		const bool Tape::isGuarded() const
+		{
+			return m_region != nullptr;
+		}
+
+		const size_t Tape::getGuardSize() const
+		{
+			/* Accessible pages past the tape don't fault */
+			return m_region && m_mapped == m_data && m_mappedSize == m_size ? GUARD_SIZE : 0;
+		}
+
+		bool Tape::runGuarded(void (*fn)(void* context), void* context)
+		{
+#if defined(BF_GUARDED_TAPE_AVAILABLE)
+			if(m_region)
+			{
+				GuardFault _fault;
+				_fault.tape = this;
+				_fault.outer = GuardFault::s_current;
+				GuardFault::s_current = &_fault;
+
+				/* The signal mask isn't saved, SA_NODEFER leaves it untouched by the handler */
+				if(sigsetjmp(_fault.jump, 0) != 0)
+				{
+					GuardFault::s_current = _fault.outer;
+					return false;
+				}
+
+				fn(context);
+				GuardFault::s_current = _fault.outer;
+				return true;
+			}
+#endif
+			fn(context);
+			return true;
+		}
+
+		/******************************************************************************/
+		void Tape::release()
+		{
+#if defined(BF_GUARDED_TAPE_AVAILABLE)
+			if(m_region)
+				munmap(m_region, m_regionSize);
+#endif
+#if defined(BF_LINUX_MM)
+			if(m_block)
+				munmap(m_block, m_blockSize);
+#endif
+			m_region = nullptr;
+			m_regionSize = 0;
+			m_reserved = 0;
+			m_mapped = nullptr;
+			m_mappedSize = 0;
+			m_block = nullptr;
+			m_blockSize = 0;
+			std::vector<char>().swap(m_heap);
+			m_data = nullptr;
+			m_size = 0;
+			m_limit = 0;
+		}
+
+		void Tape::zero(char* from, size_t size)
+		{
+#if defined(BF_LINUX_MM)
+			/* Both kinds of tape are private anonymous mappings here. Dropping their pages zeroes
+			* them, swapped out ones included, and leaves nothing resident until used again */
+			if(size >= ZERO_DROP_SIZE)
+			{
+				const uintptr_t _page = roundToPages(1);
+				char* const _first = (char*)(((uintptr_t)from + _page - 1) / _page * _page);
+				char* const _last = (char*)(((uintptr_t)from + size) / _page * _page);
+				memset(from, 0, (size_t)(_first - from));
+				madvise(_first, (size_t)(_last - _first), MADV_DONTNEED);
+				memset(_last, 0, (size_t)(from + size - _last));
+				return;
+			}
+#endif
+			memset(from, 0, size);
+		}
+
+		bool Tape::reallocate(size_t size)
+		{
+			/* Resizes the plain block, keeping what's in it. Anything new comes in zeroed */
+#if defined(BF_LINUX_MM)
+			size = roundToPages(size);
+			if(size == m_blockSize)
+				return true;
+
+			void* _block = m_block ?
+				mremap(m_block, m_blockSize, size, MREMAP_MAYMOVE) :
+				mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(_block == MAP_FAILED)
+				return false;
+			m_data = (char*)_block + (m_data - m_block);
+			m_block = (char*)_block;
+			m_blockSize = size;
+#else
+			const size_t _offset = (size_t)(m_data - m_block);
+			m_heap.resize(size, (char)0);
+			m_block = m_heap.data();
+			m_blockSize = size;
+			m_data = m_block + _offset;
+#endif
+			return true;
+		}
+
+		bool Tape::commit(size_t size, bool front)
+		{
+#if defined(BF_GUARDED_TAPE_AVAILABLE)
+			if(m_region)
+			{
+				/* Offsets into the reservation, from and to are the tape's once grown */
+				const size_t _added = size - m_size;
+				const size_t _from = (size_t)(m_data - m_region) - (front ? _added : 0);
+				const size_t _to = _from + size;
+				size_t _low = (size_t)(m_mapped - m_region);
+				size_t _high = _low + m_mappedSize;
+				if(_from < _low || _to > _high)
+				{
+					/* Whole pages are made accessible, doubling what is so far keeps the calls few.
+					* Those outside the tape were never touched or were dropped, so they come in
+					* zeroed */
+					if(_from < _low)
+					{
+						_low = _low >= GUARD_SIZE + m_mappedSize ? _low - m_mappedSize : GUARD_SIZE;
+						_low = (_from < _low ? _from : _low) / pageSize() * pageSize();
+					}
+					if(_to > _high)
+					{
+						_high = roundToPages(_to > _high + m_mappedSize ? _to : _high + m_mappedSize);
+						if(_high > m_regionSize - GUARD_SIZE)
+							_high = m_regionSize - GUARD_SIZE;
+					}
+					if(mprotect(m_region + _low, _high - _low, PROT_READ | PROT_WRITE) != 0)
+						return false;
+					m_mapped = m_region + _low;
+					m_mappedSize = _high - _low;
+				}
+				if(front)
+				{
+					m_data = m_region + _from;
+					m_shift += _added;
+				}
+				m_size = size;
+				return true;
+			}
+#endif
+			/* Grows into spare room on that side where there's enough of it */
+			const size_t _added = size - m_size;
+			const size_t _before = (size_t)(m_data - m_block);
+			const size_t _after = m_blockSize - _before - m_size;
+			if(front ? _added > _before : _added > _after)
+			{
+				/* Doubling keeps growth amortised O(1) per byte, up to the most the limit can use */
+				size_t _blockSize = m_blockSize * 2;
+				if(_blockSize < size)
+					_blockSize = size;
+				if(_blockSize > m_limit)
+					_blockSize = m_limit;
+				if(_blockSize > m_blockSize && !reallocate(_blockSize))
+					return false;
+
+				/* Half the spare room for each side, or what the other side already has if less */
+				const size_t _spare = m_blockSize - size;
+				const size_t _kept = (front ? _after : _before) < _spare / 2 ? (front ? _after : _before) : _spare / 2;
+				char* const _to = m_block + (front ? _spare - _kept + _added : _kept);
+				if(_to != m_data)
+				{
+					/* Then zero what the move uncovered */
+					char* const _end = m_data + m_size;
+					memmove(_to, m_data, m_size);
+					if(_to > m_data)
+						memset(m_data, 0, (size_t)((_to < _end ? _to : _end) - m_data));
+					else
+						memset(_to + m_size > m_data ? _to + m_size : m_data, 0, (size_t)(_end - (_to + m_size > m_data ? _to + m_size : m_data)));
+					m_data = _to;
+				}
+			}
+			if(front)
+			{
+				m_data -= _added;
+				m_shift += _added;
+			}
+			m_size = size;
+			return true;
+		}
+	}
+}
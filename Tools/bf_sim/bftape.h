@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+/* Guard pages need mmap/mprotect and a SIGSEGV handler, elsewhere every tape is plain */
+#if defined(__unix__) || defined(__APPLE__)
+	#define BF_GUARDED_TAPE_AVAILABLE
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* Zero-filled cell storage of a machine, sizes in bytes. Grows at either end up to its
+		* limit, growing in front moves every cell back and adds to getShift(). Spare room is
+		* kept on both sides, so growing a few bytes at a time stays cheap.
+		*
+		* A plain tape sits in one block, mremap'ed where available so growth doesn't copy.
+		* A guarded tape reserves room for its limit on both sides with mmap, between two
+		* PROT_NONE guard regions, and only makes the pages in use accessible. It never moves.
+		* When the tape fills its pages exactly, touching anything within getGuardSize() bytes
+		* past either end ends runGuarded() early, so code inside it may skip bounds checks as
+		* long as it reaches no further.
+		*
+		* Clearing a big mapped tape (see assign()) hands its pages back instead of writing zeroes. */
+		class Tape
+		{
+		public:
+
+			Tape();
+			~Tape();
+			Tape(const Tape&) = delete;
+			Tape& operator=(const Tape&) = delete;
+
+			/* Zeroed tape of "size" bytes that may grow up to "limit". Reuses the current
+			* allocation when the layout is unchanged. Falls back to a plain tape when guard pages
+			* aren't available. */
+			void assign(size_t size, size_t limit, bool guarded);
+
+			/* New size and limit, keeps the contents that still fit */
+			void resize(size_t size, size_t limit);
+
+			/* Grow to at least "size" bytes, at the end or in front. False past the limit */
+			bool grow(size_t size);
+			bool growFront(size_t size);
+
+			char* data() { return m_data; }
+			const char* data() const { return m_data; }
+			char& operator[](size_t index) { return m_data[index]; }
+			const char& operator[](size_t index) const { return m_data[index]; }
+
+			const size_t size() const;
+			const size_t capacity() const;	// Bytes usable without moving the data
+			const size_t getLimit() const;
+			const size_t getShift() const;	// Bytes added in front since assign()
+			const bool isGuarded() const;
+			const size_t getGuardSize() const;	// 0 unless both ends of the tape are on a page boundary
+
+			/* Calls fn(context) with guard page faults on this tape handled, see above. Returns
+			* false if a fault ended the call: fn is abandoned mid-way, so it must not own
+			* anything that needs destroying. */
+			bool runGuarded(void (*fn)(void* context), void* context);
+
+		public:
+
+			static const size_t GUARD_SIZE = (size_t)1 << 20;
+			static const size_t ZERO_DROP_SIZE = (size_t)1 << 20;	// Clearing this much drops the pages instead of zeroing them
+
+		private:
+
+			void release();
+			bool reallocate(size_t size);
+			void zero(char* from, size_t size);
+			bool commit(size_t size, bool front);
+
+			friend struct GuardFault;
+
+		private:
+
+			char* m_data;
+			size_t m_size;
+			size_t m_limit;
+			size_t m_shift;
+			char* m_block;				// Plain tape storage, zero outside the tape
+			size_t m_blockSize;
+			std::vector<char> m_heap;	// Plain tape storage without mremap
+			char* m_region;				// Reservation of a guarded tape, guards included
+			size_t m_regionSize;
+			size_t m_reserved;			// Bytes of the reservation on either side of where the tape starts
+			char* m_mapped;				// Accessible whole pages of the reservation, around the tape
+			size_t m_mappedSize;
+		};
+	}
+}
@@ -0,0 +1,429 @@
+#include "bfsim.h"
+#include "bfscan.h"
+
+#include <stdint.h>
+
+#include <type_traits>
+
+/* Labels-as-values is a GCC/Clang extension, everything else gets a plain switch loop */
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(BF_NO_COMPUTED_GOTO)
+	#define BF_COMPUTED_GOTO
+#endif
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		static const size_t OUT_OF_TAPE = (size_t)-1;
+
+		/* Cell arithmetic of a dialect. Cells are unsigned, deltas come signed from the IR */
+		template<class Cell, Overflow O> struct CellMath;
+
+		template<class Cell> struct CellMath<Cell, Overflow::WRAP>
+		{
+			static inline Cell add(Cell cell, int delta)
+			{
+				return (Cell)(cell + (Cell)delta);
+			}
+
+			static inline Cell mulAdd(Cell cell, Cell src, int factor)
+			{
+				return (Cell)(cell + (Cell)(src * (Cell)factor));
+			}
+		};
+
+		template<class Cell> struct CellMath<Cell, Overflow::SATURATE>
+		{
+			static const uint64_t MAX = (Cell)~(Cell)0;
+
+			static inline Cell addMagnitude(Cell cell, uint64_t magnitude, bool up)
+			{
+				if(up)
+					return magnitude > MAX - cell ? (Cell)MAX : (Cell)(cell + magnitude);
+				return magnitude > cell ? (Cell)0 : (Cell)(cell - magnitude);
+			}
+
+			static inline Cell add(Cell cell, int delta)
+			{
+				return delta >= 0 ? addMagnitude(cell, (uint64_t)delta, true) : addMagnitude(cell, (uint64_t)-(long long)delta, false);
+			}
+
+			/* Adding factor src times, in one go */
+			static inline Cell mulAdd(Cell cell, Cell src, int factor)
+			{
+				const uint64_t _factor = factor >= 0 ? (uint64_t)factor : (uint64_t)-(long long)factor;
+				const uint64_t _product = _factor != 0 && src > UINT64_MAX / _factor ? UINT64_MAX : src * _factor;
+				return addMagnitude(cell, _product, factor >= 0);
+			}
+		};
+
+		/* Tape index of DP + offset under an edge policy. ERROR and GROW return OUT_OF_TAPE
+		* for the caller to fault or grow. */
+		template<TapeEdge T> static inline size_t tapeIndex(long long idx, size_t size)
+		{
+			if((unsigned long long)idx < size)
+				return (size_t)idx;
+
+			if(T == TapeEdge::CLAMP)
+				return idx < 0 ? 0 : size - 1;
+			if(T == TapeEdge::WRAP)
+			{
+				idx %= (long long)size;
+				return (size_t)(idx < 0 ? idx + (long long)size : idx);
+			}
+			return OUT_OF_TAPE;
+		}
+
+		/* scanZero for any cell width */
+		template<class Cell> static inline size_t scanCells(const Cell* memory, size_t size, size_t pos, int stride)
+		{
+			if(sizeof(Cell) == 1)
+				return scanZero((const char*)memory, size, pos, stride);
+
+			long long _idx = (long long)pos;
+			while(_idx >= 0 && _idx < (long long)size)
+			{
+				if(memory[_idx] == 0)
+					return (size_t)_idx;
+				_idx += stride;
+			}
+			return SCAN_NOT_FOUND;
+		}
+
+		/******************************************************************************/
+		size_t BF_Machine::runThreaded(size_t maxTicks)
+		{
+			if(!m_dataMemory.isGuarded())
+				return (this->*m_runThreaded)(maxTicks);
+
+			struct Call
+			{
+				BF_Machine* machine;
+				size_t maxTicks;
+				size_t ticks;
+			};
+			Call _call = { this, maxTicks, 0 };
+
+			/* A fault on a guard page leaves the run mid-way: the tape holds what it wrote, but the
+			* position and tick count are still those from before the call */
+			if(!m_dataMemory.runGuarded([](void* context) {
+					Call* _call = (Call*)context;
+					_call->ticks = (_call->machine->*_call->machine->m_runThreaded)(_call->maxTicks);
+				}, &_call))
+			{
+				m_state = MachineState::FAULTED;
+				return 0;
+			}
+			return _call.ticks;
+		}
+
+		template<class Cell, Overflow O, EofMode E, TapeEdge T, bool G, bool H>
+		size_t BF_Machine::runThreadedAs(size_t maxTicks)
+		{
+			typedef CellMath<Cell, O> Math;
+
+			/* Only GROW changes these while running, see REBASE() */
+			Cell* _mem = (Cell*)m_dataMemory.data();
+			size_t _memSize = getDataMemoSize();
+			const Op* const _ops = m_program->getOps().data();
+
+			size_t _pc = m_pc;
+			size_t _dp = m_dataMemoryPtr;
+			size_t _ticks = 0;
+			long long _at = 0;	// Position that went past the tape, for the edge handler
+			size_t _shift = m_dataMemory.getShift();
+			const bool _stopOnOutput = m_runLimits && m_runLimits->stopOnOutput;
+			const bool _lineBuffered = m_lineBuffered;
+
+			/* Back-edge counters, only where the run may carry on in JIT code, see tierUp() */
+			unsigned int* const _hot = H && m_runLimits && m_runLimits->maxTicks == (size_t)-1 &&
+				m_runLimits->deadline == RunLimits::Clock::time_point::max() ? m_backEdges.data() : nullptr;
+
+			/* GROW may add cells in front, which moves every cell back. Positions follow */
+#define REBASE() \
+			_dp += (m_dataMemory.getShift() - _shift) / sizeof(Cell); \
+			_at += (long long)((m_dataMemory.getShift() - _shift) / sizeof(Cell)); \
+			_shift = m_dataMemory.getShift(); \
+			_mem = (Cell*)m_dataMemory.data(); \
+			_memSize = getDataMemoSize()
+
+			/* Index of DP + offset into "var". The edge check folds away unless the policy can fail */
+#define INDEX(var, offset) \
+			const size_t var = tapeIndex<T>(_at = (long long)_dp + (offset), _memSize); \
+			if((T == TapeEdge::ERROR || T == TapeEdge::GROW) && var == OUT_OF_TAPE) goto edge
+
+			/* Same for cell accesses. Moves stay checked so DP is always on the tape, unchecked
+			* code then reaches at most the program's reach past it, into the guard pages */
+#define ACCESS(var, offset) \
+			const ptrdiff_t var = G ? (ptrdiff_t)_dp + (offset) : (ptrdiff_t)tapeIndex<T>(_at = (long long)_dp + (offset), _memSize); \
+			if(!G && (T == TapeEdge::ERROR || T == TapeEdge::GROW) && var == (ptrdiff_t)OUT_OF_TAPE) goto edge
+
+#if defined(BF_COMPUTED_GOTO)
+			/* Handler addresses, in OpCode order, plus the halt handler past the last op */
+			static const void* const _HANDLERS[] = {
+				&&op_ADD, &&op_MOVE, &&op_OUT, &&op_IN, &&op_JZ, &&op_JNZ, &&op_CLEAR, &&op_MULADD, &&op_SCAN,
+			};
+
+			/* Pre-decoded once per program and instantiation, shared by all machines running it */
+			const void* const* const _code = m_program->getThreadedCode(_HANDLERS, &&op_END);
+
+	#define HANDLER(name) op_##name:
+	#define NEXT() _pc++; DISPATCH()
+	#define DISPATCH() if(_ticks >= maxTicks) goto exit; _ticks++; goto *_code[_pc]
+
+		resume:
+			DISPATCH();
+#else
+	#define HANDLER(name) case OpCode::name:
+	#define NEXT() _pc++; continue
+	#define DISPATCH() continue
+
+			const size_t _opCount = m_program->getOps().size();
+
+		resume:
+			for(;;)
+			{
+				if(_pc >= _opCount) goto op_HALT;
+				if(_ticks >= maxTicks) goto exit;
+				_ticks++;
+
+				switch(_ops[_pc].code)
+				{
+#endif
+					HANDLER(ADD)
+					{
+						ACCESS(_i, _ops[_pc].offset);
+						_mem[_i] = Math::add(_mem[_i], _ops[_pc].arg);
+						NEXT();
+					}
+
+					HANDLER(MOVE)
+					{
+						INDEX(_i, _ops[_pc].arg);
+						_dp = _i;
+						NEXT();
+					}
+
+					HANDLER(OUT)
+					{
+						/* Plain push while there's room, the slow path flushes, applies backpressure and stop conditions */
+						ACCESS(_i, _ops[_pc].offset);
+						const char _value = (char)_mem[_i];
+						if(!_stopOnOutput && !m_stdOut.full() && !(_lineBuffered && _value == '\n'))
+							m_stdOut.push(_value);
+						else if(!writeOutput(_value))
+						{
+							_ticks--; // Not run, resumes here once the sink takes output
+							goto exit;
+						}
+						else if(_stopOnOutput)
+						{
+							_pc++;
+							goto exit;
+						}
+						NEXT();
+					}
+
+					HANDLER(IN)
+					{
+						ACCESS(_i, _ops[_pc].offset);
+						if(!m_stdIn.empty())
+							_mem[_i] = (Cell)(unsigned char)m_stdIn.pop();
+						else
+						{
+							const int _byte = readInput();
+							if(_byte == INPUT_BLOCKED)
+							{
+								_ticks--; // Not run, resumes here once input arrives
+								goto exit;
+							}
+							if(_byte != INPUT_END)
+								_mem[_i] = (Cell)_byte;
+							else if(E == EofMode::ZERO)
+								_mem[_i] = 0;
+							else if(E == EofMode::ALL_ONES)
+								_mem[_i] = (Cell)~(Cell)0;
+						}
+						NEXT();
+					}
+
+					HANDLER(JZ)
+						if(_mem[_dp] == 0)
+							_pc = _ops[_pc].target;
+						NEXT();
+
+					HANDLER(JNZ)
+						if(_mem[_dp] != 0)
+						{
+							if(H && _hot && ++_hot[_pc] >= TIER_UP_BACK_EDGES)
+							{
+								/* Hot loop, stop at the start of its body for the JIT to take over */
+								_pc = _ops[_pc].target + 1;
+								m_hotLoop = true;
+								goto exit;
+							}
+							_pc = _ops[_pc].target;
+						}
+						NEXT();
+
+					HANDLER(CLEAR)
+					{
+						ACCESS(_i, _ops[_pc].offset);
+						_mem[_i] = 0;
+						NEXT();
+					}
+
+					HANDLER(MULADD)
+					{
+						ACCESS(_src, _ops[_pc].srcOffset);
+						ACCESS(_i, _ops[_pc].offset);
+						_mem[_i] = Math::mulAdd(_mem[_i], _mem[_src], _ops[_pc].arg);
+						NEXT();
+					}
+
+					HANDLER(SCAN)
+					{
+						const int _stride = _ops[_pc].arg;
+						size_t _zero = scanCells(_mem, _memSize, _dp, _stride);
+						if(_zero == SCAN_NOT_FOUND)
+						{
+							/* Ran off the tape */
+							if(T == TapeEdge::WRAP)
+							{
+								/* Every reachable cell comes up within one lap of the ring */
+								size_t _pos = _dp;
+								for(size_t i = 0; i < _memSize && _zero == SCAN_NOT_FOUND; i++)
+								{
+									if(_mem[_pos] == 0)
+										_zero = _pos;
+									_pos = tapeIndex<T>((long long)_pos + _stride, _memSize);
+								}
+							}
+							else if(T == TapeEdge::ERROR || T == TapeEdge::GROW)
+							{
+								/* First stop past the end, a fresh cell is zero once grown */
+								const long long _steps = _stride > 0 ? ((long long)_memSize - 1 - (long long)_dp) / _stride + 1 : (long long)_dp / -_stride + 1;
+								_at = (long long)_dp + _steps * _stride;
+								goto edge;
+							}
+
+							if(_zero == SCAN_NOT_FOUND)
+							{
+								/* Moves clamp at the edge, or a ring without a zero cell */
+								if(T != TapeEdge::WRAP)
+									_dp = _stride > 0 ? _memSize - 1 : 0;
+								if(_mem[_dp] != 0)
+									DISPATCH(); // Stuck, spin like the plain loop would
+								NEXT();
+							}
+						}
+						_dp = _zero;
+						NEXT();
+					}
+#if !defined(BF_COMPUTED_GOTO)
+				}
+			}
+#endif
+
+#if defined(BF_COMPUTED_GOTO)
+		op_END:
+			_ticks--; // Reaching the end isn't an instruction
+			goto op_HALT;
+#endif
+
+		edge:
+			/* The op at _pc went past the tape and hasn't run. Grow and run it again, or fault */
+			_ticks--;
+			if(T == TapeEdge::GROW)
+			{
+				if(growDataMemory(_at))
+				{
+					REBASE();
+					goto resume;
+				}
+			}
+			m_state = MachineState::FAULTED;
+			goto exit;
+
+		op_HALT:
+			m_state = MachineState::HALTED;
+
+		exit:
+			if(T == TapeEdge::GROW)
+			{
+				REBASE();
+			}
+			m_pc = (unsigned int)_pc;
+			m_dataMemoryPtr = (unsigned int)_dp;
+			m_ticks += _ticks;
+			syncInstructionPtr();
+			return _ticks;
+
+#undef REBASE
+#undef INDEX
+#undef ACCESS
+#undef HANDLER
+#undef NEXT
+#undef DISPATCH
+		}
+
+		/******************************************************************************/
+		void BF_Machine::bindThreaded()
+		{
+			/* Unchecked only if the furthest access from DP stays within the guard */
+			const bool _unchecked = m_dataMemory.isGuarded() && m_program->getReach() * getCellSize() < m_dataMemory.getGuardSize();
+			const bool _counting = m_engine == Engine::TIERED;
+			m_runThreaded = selectThreaded(m_program->getDialect(), _unchecked, _counting);
+			m_backEdges.assign(_counting ? m_program->getOps().size() : 0, 0);
+		}
+
+		BF_Machine::ThreadedRun BF_Machine::selectThreaded(const Dialect& dialect, bool unchecked, bool counting)
+		{
+			/* TIERED programs are always classic */
+			if(counting)
+				return &BF_Machine::runThreadedAs<uint8_t, Overflow::WRAP, EofMode::UNCHANGED, TapeEdge::CLAMP, false, true>;
+
+			/* Walks the dialect down to one instantiation, tags carry what's been picked so far */
+			auto _byEdge = [&](auto cell, auto overflow, auto eof) -> ThreadedRun {
+				typedef decltype(cell) Cell;
+				constexpr Overflow O = decltype(overflow)::value;
+				constexpr EofMode E = decltype(eof)::value;
+				switch(dialect.edge)
+				{
+					case TapeEdge::ERROR:
+						if(unchecked)
+							return &BF_Machine::runThreadedAs<Cell, O, E, TapeEdge::ERROR, true, false>;
+						return &BF_Machine::runThreadedAs<Cell, O, E, TapeEdge::ERROR, false, false>;
+					case TapeEdge::WRAP: return &BF_Machine::runThreadedAs<Cell, O, E, TapeEdge::WRAP, false, false>;
+					case TapeEdge::GROW: return &BF_Machine::runThreadedAs<Cell, O, E, TapeEdge::GROW, false, false>;
+					default: return &BF_Machine::runThreadedAs<Cell, O, E, TapeEdge::CLAMP, false, false>;
+				}
+			};
+
+			auto _byEof = [&](auto cell, auto overflow) -> ThreadedRun {
+				switch(dialect.eof)
+				{
+					case EofMode::ZERO: return _byEdge(cell, overflow, std::integral_constant<EofMode, EofMode::ZERO>());
+					case EofMode::ALL_ONES: return _byEdge(cell, overflow, std::integral_constant<EofMode, EofMode::ALL_ONES>());
+					default: return _byEdge(cell, overflow, std::integral_constant<EofMode, EofMode::UNCHANGED>());
+				}
+			};
+
+			auto _byOverflow = [&](auto cell) -> ThreadedRun {
+				if(dialect.overflow == Overflow::SATURATE)
+					return _byEof(cell, std::integral_constant<Overflow, Overflow::SATURATE>());
+				return _byEof(cell, std::integral_constant<Overflow, Overflow::WRAP>());
+			};
+
+			switch(dialect.cellBits)
+			{
+				case 16: return _byOverflow(uint16_t());
+				case 32: return _byOverflow(uint32_t());
+				case 64: return _byOverflow(uint64_t());
+				default: return _byOverflow(uint8_t());
+			}
+		}
+	}
+}
@@ -0,0 +1,449 @@
+#include "bfx64.h"
+
+#include <string.h>
+#include <initializer_list>
+#include <utility>
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		enum Reg
+		{
+			RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+			R8, R9, R10, R11, R12, R13, R14, R15,
+		};
+
+		/* Register roles in generated code */
+		static const Reg REG_CELL = RBX;
+		static const Reg REG_LO = R13;
+		static const Reg REG_HI = R14;
+		static const Reg REG_FRAME = R15;
+		static const Reg REG_OUT_BUF = R15;	// SYSCALL mode
+		static const Reg REG_OUT_LEN = R12;	// SYSCALL mode
+
+		static const int FRAME_CELL = (int)offsetof(JitFrame, cell);
+		static const int FRAME_LO = (int)offsetof(JitFrame, lo);
+		static const int FRAME_HI = (int)offsetof(JitFrame, hi);
+		static const int FRAME_CTX = (int)offsetof(JitFrame, ctx);
+		static const int FRAME_PUT = (int)offsetof(JitFrame, put);
+		static const int FRAME_GET = (int)offsetof(JitFrame, get);
+		static const int FRAME_SCAN = (int)offsetof(JitFrame, scan);
+		static const int FRAME_ENTRY = (int)offsetof(JitFrame, entry);
+		static const int FRAME_EXIT_OP = (int)offsetof(JitFrame, exitOp);
+
+		/******************************************************************************/
+		class Assembler
+		{
+		public:
+
+			Assembler(std::vector<unsigned char>& bytes) : m_bytes(bytes) {}
+
+			size_t size() const { return m_bytes.size(); }
+
+			void byte(unsigned char b) { m_bytes.push_back(b); }
+
+			void dword(unsigned int v)
+			{
+				for(int i = 0; i < 4; i++)
+					byte((unsigned char)(v >> (i * 8)));
+			}
+
+			void qword(unsigned long long v)
+			{
+				for(int i = 0; i < 8; i++)
+					byte((unsigned char)(v >> (i * 8)));
+			}
+
+			void patchRel32(size_t at, size_t target)
+			{
+				int _rel = (int)((long long)target - (long long)(at + 4));
+				memcpy(&m_bytes[at], &_rel, 4);
+			}
+
+			void rex(bool w, int reg, int rm)
+			{
+				unsigned char _rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+				if(_rex != 0x40)
+					byte(_rex);
+			}
+
+			/* <opcode> reg, [base + disp32] */
+			void mem(bool w, std::initializer_list<unsigned char> opcode, int reg, Reg base, int disp)
+			{
+				rex(w, reg, base);
+				for(unsigned char _b : opcode)
+					byte(_b);
+				byte((unsigned char)(0x80 | ((reg & 7) << 3) | (base & 7)));
+				if((base & 7) == RSP)
+					byte(0x24); // SIB, no index
+				dword((unsigned int)disp);
+			}
+
+			/* <opcode> reg, rm (register direct) */
+			void reg(bool w, std::initializer_list<unsigned char> opcode, int reg, int rm)
+			{
+				rex(w, reg, rm);
+				for(unsigned char _b : opcode)
+					byte(_b);
+				byte((unsigned char)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+			}
+
+			void push(Reg r) { rex(false, 0, r); byte((unsigned char)(0x50 + (r & 7))); }
+			void pop(Reg r) { rex(false, 0, r); byte((unsigned char)(0x58 + (r & 7))); }
+
+			/* Emits a rel32 jump/branch, returns the position of the displacement to patch */
+			size_t jump(std::initializer_list<unsigned char> opcode)
+			{
+				for(unsigned char _b : opcode)
+					byte(_b);
+				size_t _at = size();
+				dword(0);
+				return _at;
+			}
+
+		private:
+
+			std::vector<unsigned char>& m_bytes;
+		};
+
+		/******************************************************************************/
+		class X64Emitter
+		{
+		public:
+
+			X64Emitter(const std::vector<Op>& program, const X64Options& options, X64Code& out) :
+				m_program(program),
+				m_options(options),
+				m_out(out),
+				m_asm(out.bytes)
+			{}
+
+			void emit()
+			{
+				m_out.bytes.clear();
+				m_out.opOffsets.assign(m_program.size() + 1, 0);
+
+				emitPrologue();
+
+				std::vector<size_t> _jumpFixups(m_program.size(), 0);
+
+				for(size_t i = 0; i < m_program.size(); i++)
+				{
+					const Op& _op = m_program[i];
+					m_out.opOffsets[i] = (unsigned int)m_asm.size();
+
+					switch(_op.code)
+					{
+						case OpCode::ADD:
+						{
+							Reg _base = cellAddress(RAX, _op.offset);
+							m_asm.mem(false, { 0x80 }, 0, _base, baseDisp(_base, _op.offset)); // add byte [m], imm8
+							m_asm.byte((unsigned char)_op.arg);
+							break;
+						}
+
+						case OpCode::MOVE:
+							m_asm.mem(true, { 0x8D }, REG_CELL, REG_CELL, _op.arg); // lea rbx, [rbx + arg]
+							if(m_options.boundsChecks)
+								clamp(REG_CELL);
+							break;
+
+						case OpCode::CLEAR:
+						{
+							Reg _base = cellAddress(RAX, _op.offset);
+							m_asm.mem(false, { 0xC6 }, 0, _base, baseDisp(_base, _op.offset)); // mov byte [m], 0
+							m_asm.byte(0);
+							break;
+						}
+
+						case OpCode::MULADD:
+						{
+							Reg _src = cellAddress(RCX, _op.srcOffset);
+							m_asm.mem(false, { 0x0F, 0xB6 }, RAX, _src, baseDisp(_src, _op.srcOffset)); // movzx eax, byte [src]
+							m_asm.reg(false, { 0x69 }, RAX, RAX); // imul eax, eax, imm32
+							m_asm.dword((unsigned int)_op.arg);
+							Reg _dst = cellAddress(RDX, _op.offset);
+							m_asm.mem(false, { 0x00 }, RAX, _dst, baseDisp(_dst, _op.offset)); // add byte [dst], al
+							break;
+						}
+
+						case OpCode::OUT:
+						{
+							if(m_options.io == X64Io::SYSCALL)
+							{
+								emitBufferedOut(_op);
+								break;
+							}
+
+							Reg _base = cellAddress(RAX, _op.offset);
+							m_asm.mem(false, { 0x0F, 0xB6 }, RSI, _base, baseDisp(_base, _op.offset)); // movzx esi, byte [m]
+							m_asm.mem(true, { 0x8B }, RDI, REG_FRAME, FRAME_CTX); // mov rdi, ctx
+							m_asm.mem(false, { 0xFF }, 2, REG_FRAME, FRAME_PUT); // call [put]
+							suspendIfNonZero(i);
+							break;
+						}
+
+						case OpCode::IN:
+						{
+							if(m_options.io == X64Io::SYSCALL)
+							{
+								emitSyscallIn(_op);
+								break;
+							}
+
+							Reg _base = cellAddress(RAX, _op.offset);
+							m_asm.mem(true, { 0x8D }, RSI, _base, baseDisp(_base, _op.offset)); // lea rsi, [m]
+							m_asm.mem(true, { 0x8B }, RDI, REG_FRAME, FRAME_CTX); // mov rdi, ctx
+							m_asm.mem(false, { 0xFF }, 2, REG_FRAME, FRAME_GET); // call [get]
+							suspendIfNonZero(i);
+							break;
+						}
+
+						case OpCode::JZ:
+						case OpCode::JNZ:
+							m_asm.mem(false, { 0x80 }, 7, REG_CELL, 0); // cmp byte [rbx], 0
+							m_asm.byte(0);
+							_jumpFixups[i] = m_asm.jump({ 0x0F, (unsigned char)(_op.code == OpCode::JZ ? 0x84 : 0x85) });
+							break;
+
+						case OpCode::SCAN:
+							emitScan(_op, i);
+							break;
+					}
+				}
+				m_out.opOffsets[m_program.size()] = (unsigned int)m_asm.size();
+
+				/* Both JZ and JNZ continue past the matching op */
+				for(size_t i = 0; i < m_program.size(); i++)
+				{
+					if(m_program[i].code == OpCode::JZ || m_program[i].code == OpCode::JNZ)
+						m_asm.patchRel32(_jumpFixups[i], m_out.opOffsets[m_program[i].target + 1]);
+				}
+
+				if(m_options.io == X64Io::SYSCALL)
+				{
+					emitSyscallExit();
+					emitFlush();
+					return;
+				}
+
+				emitExit((unsigned int)m_program.size());
+				for(const auto& _suspend : m_suspends)
+				{
+					m_asm.patchRel32(_suspend.first, m_asm.size());
+					emitExit(_suspend.second);
+				}
+			}
+
+		private:
+
+			void emitPrologue()
+			{
+				if(m_options.io == X64Io::SYSCALL)
+				{
+					movImm64(REG_CELL, m_options.tapeAddress);
+					movImm64(REG_LO, m_options.tapeAddress);
+					movImm64(REG_HI, m_options.tapeAddress + m_options.tapeSize - 1);
+					movImm64(REG_OUT_BUF, m_options.outBufferAddress);
+					m_asm.reg(false, { 0x31 }, REG_OUT_LEN, REG_OUT_LEN); // xor r12d, r12d
+					return;
+				}
+
+				for(Reg _r : { RBX, RBP, R12, R13, R14, R15 })
+					m_asm.push(_r);
+				m_asm.reg(true, { 0x83 }, 5, RSP); m_asm.byte(8); // sub rsp, 8 (keep calls 16-byte aligned)
+
+				m_asm.reg(true, { 0x89 }, RDI, REG_FRAME); // mov r15, rdi
+				m_asm.mem(true, { 0x8B }, REG_CELL, REG_FRAME, FRAME_CELL);
+				m_asm.mem(true, { 0x8B }, REG_LO, REG_FRAME, FRAME_LO);
+				m_asm.mem(true, { 0x8B }, REG_HI, REG_FRAME, FRAME_HI);
+				m_asm.mem(false, { 0xFF }, 4, REG_FRAME, FRAME_ENTRY); // jmp [entry]
+			}
+
+			/* Stores DP and the op to resume at, then returns from generated code */
+			void emitExit(unsigned int exitOp)
+			{
+				m_asm.mem(true, { 0x89 }, REG_CELL, REG_FRAME, FRAME_CELL);
+				m_asm.mem(false, { 0xC7 }, 0, REG_FRAME, FRAME_EXIT_OP); // mov dword [exitOp], imm32
+				m_asm.dword(exitOp);
+
+				m_asm.reg(true, { 0x83 }, 0, RSP); m_asm.byte(8); // add rsp, 8
+				for(Reg _r : { R15, R14, R13, R12, RBP, RBX })
+					m_asm.pop(_r);
+				m_asm.byte(0xC3);
+			}
+
+			void movImm64(Reg r, unsigned long long value)
+			{
+				m_asm.rex(true, 0, r);
+				m_asm.byte((unsigned char)(0xB8 + (r & 7)));
+				m_asm.qword(value);
+			}
+
+			void movImm32(Reg r, unsigned int value)
+			{
+				m_asm.rex(false, 0, r);
+				m_asm.byte((unsigned char)(0xB8 + (r & 7)));
+				m_asm.dword(value);
+			}
+
+			void callFlush()
+			{
+				m_flushCalls.push_back(m_asm.jump({ 0xE8 }));
+			}
+
+			/* buf[len++] = cell; if(len == X64_OUT_BUFFER_SIZE) flush(); */
+			void emitBufferedOut(const Op& op)
+			{
+				Reg _base = cellAddress(RAX, op.offset);
+				m_asm.mem(false, { 0x0F, 0xB6 }, RAX, _base, baseDisp(_base, op.offset)); // movzx eax, byte [m]
+				m_asm.byte(0x43); m_asm.byte(0x88); m_asm.byte(0x04); m_asm.byte(0x27); // mov [r15 + r12], al
+				m_asm.reg(true, { 0xFF }, 0, REG_OUT_LEN); // inc r12
+				m_asm.reg(true, { 0x81 }, 7, REG_OUT_LEN); // cmp r12, imm32
+				m_asm.dword(X64_OUT_BUFFER_SIZE);
+				size_t _skip = m_asm.jump({ 0x0F, 0x85 }); // jne
+				callFlush();
+				m_asm.patchRel32(_skip, m_asm.size());
+			}
+
+			/* Flush pending output so prompts show up, then read(0, &cell, 1). EOF leaves the cell unchanged */
+			void emitSyscallIn(const Op& op)
+			{
+				callFlush();
+				Reg _base = cellAddress(RAX, op.offset);
+				m_asm.mem(true, { 0x8D }, RSI, _base, baseDisp(_base, op.offset)); // lea rsi, [m]
+				movImm32(RAX, 0); // SYS_read
+				movImm32(RDI, 0);
+				movImm32(RDX, 1);
+				m_asm.byte(0x0F); m_asm.byte(0x05);
+			}
+
+			void emitSyscallExit()
+			{
+				callFlush();
+				movImm32(RAX, 60); // SYS_exit
+				m_asm.reg(false, { 0x31 }, RDI, RDI);
+				m_asm.byte(0x0F); m_asm.byte(0x05);
+			}
+
+			/* Writes out buf[0, len), retrying on short writes, and resets len. Errors drop the output */
+			void emitFlush()
+			{
+				size_t _flush = m_asm.size();
+				for(size_t _call : m_flushCalls)
+					m_asm.patchRel32(_call, _flush);
+
+				m_asm.reg(true, { 0x89 }, REG_OUT_BUF, RSI); // mov rsi, r15
+				m_asm.reg(true, { 0x89 }, REG_OUT_LEN, RDX); // mov rdx, r12
+				size_t _loop = m_asm.size();
+				m_asm.reg(true, { 0x85 }, RDX, RDX); // test rdx, rdx
+				size_t _done = m_asm.jump({ 0x0F, 0x84 });
+				movImm32(RAX, 1); // SYS_write
+				movImm32(RDI, 1);
+				m_asm.byte(0x0F); m_asm.byte(0x05);
+				m_asm.reg(true, { 0x85 }, RAX, RAX); // test rax, rax
+				size_t _failed = m_asm.jump({ 0x0F, 0x8E }); // jle
+				m_asm.reg(true, { 0x01 }, RAX, RSI); // add rsi, rax
+				m_asm.reg(true, { 0x29 }, RAX, RDX); // sub rdx, rax
+				m_asm.patchRel32(m_asm.jump({ 0xE9 }), _loop);
+
+				m_asm.patchRel32(_done, m_asm.size());
+				m_asm.patchRel32(_failed, m_asm.size());
+				m_asm.reg(false, { 0x31 }, REG_OUT_LEN, REG_OUT_LEN); // xor r12d, r12d
+				m_asm.byte(0xC3);
+			}
+
+			void suspendIfNonZero(size_t op)
+			{
+				m_asm.reg(false, { 0x85 }, RAX, RAX); // test eax, eax
+				m_suspends.push_back({ m_asm.jump({ 0x0F, 0x85 }), (unsigned int)op });
+			}
+
+			/* cmp r, lo; cmovb r, lo; cmp r, hi; cmova r, hi */
+			void clamp(Reg r)
+			{
+				m_asm.reg(true, { 0x39 }, REG_LO, r);
+				m_asm.reg(true, { 0x0F, 0x42 }, r, REG_LO);
+				m_asm.reg(true, { 0x39 }, REG_HI, r);
+				m_asm.reg(true, { 0x0F, 0x47 }, r, REG_HI);
+			}
+
+			/* Returns base register for accessing cell[DP + offset], computing a clamped address into scratch if needed */
+			Reg cellAddress(Reg scratch, int offset)
+			{
+				if(offset == 0 || !m_options.boundsChecks)
+					return REG_CELL;
+
+				m_asm.mem(true, { 0x8D }, scratch, REG_CELL, offset); // lea scratch, [rbx + offset]
+				clamp(scratch);
+				return scratch;
+			}
+
+			int baseDisp(Reg base, int offset) const
+			{
+				return base == REG_CELL ? offset : 0;
+			}
+
+			void emitScan(const Op& op, size_t index)
+			{
+				if(m_options.io == X64Io::SYSCALL)
+				{
+					/* No host to call into, plain loop. Getting stuck at an edge spins like the source loop */
+					size_t _loop = m_asm.size();
+					m_asm.mem(false, { 0x80 }, 7, REG_CELL, 0); // cmp byte [rbx], 0
+					m_asm.byte(0);
+					size_t _done = m_asm.jump({ 0x0F, 0x84 });
+					m_asm.mem(true, { 0x8D }, REG_CELL, REG_CELL, op.arg); // lea rbx, [rbx + stride]
+					if(m_options.boundsChecks)
+						clamp(REG_CELL);
+					m_asm.patchRel32(m_asm.jump({ 0xE9 }), _loop);
+					m_asm.patchRel32(_done, m_asm.size());
+					return;
+				}
+
+				/* idx = scan(lo, hi - lo + 1, rbx - lo, stride) */
+				m_asm.reg(true, { 0x89 }, REG_LO, RDI); // mov rdi, r13
+				m_asm.reg(true, { 0x89 }, REG_HI, RSI); // mov rsi, r14
+				m_asm.reg(true, { 0x29 }, REG_LO, RSI); // sub rsi, r13
+				m_asm.reg(true, { 0x83 }, 0, RSI); m_asm.byte(1); // add rsi, 1
+				m_asm.reg(true, { 0x89 }, REG_CELL, RDX); // mov rdx, rbx
+				m_asm.reg(true, { 0x29 }, REG_LO, RDX); // sub rdx, r13
+				m_asm.byte(0xB9); m_asm.dword((unsigned int)op.arg); // mov ecx, stride
+				m_asm.mem(false, { 0xFF }, 2, REG_FRAME, FRAME_SCAN); // call [scan]
+
+				m_asm.reg(true, { 0x83 }, 7, RAX); m_asm.byte(0xFF); // cmp rax, -1
+				size_t _notFound = m_asm.jump({ 0x0F, 0x84 }); // je
+				m_asm.mem(true, { 0x8D }, REG_CELL, REG_LO, 0); // lea rbx, [r13]
+				m_asm.reg(true, { 0x01 }, RAX, REG_CELL); // add rbx, rax
+				size_t _done = m_asm.jump({ 0xE9 });
+
+				/* Ran off data memory, DP clamps at the edge */
+				m_asm.patchRel32(_notFound, m_asm.size());
+				m_asm.reg(true, { 0x89 }, op.arg > 0 ? REG_HI : REG_LO, REG_CELL);
+				m_asm.mem(false, { 0x80 }, 7, REG_CELL, 0); // cmp byte [rbx], 0
+				m_asm.byte(0);
+				m_suspends.push_back({ m_asm.jump({ 0x0F, 0x85 }), (unsigned int)index }); // Stuck, let the host decide
+
+				m_asm.patchRel32(_done, m_asm.size());
+			}
+
+		private:
+
+			const std::vector<Op>& m_program;
+			const X64Options& m_options;
+			X64Code& m_out;
+			Assembler m_asm;
+			std::vector<std::pair<size_t, unsigned int>> m_suspends; // Branch to patch, op to resume at
+			std::vector<size_t> m_flushCalls; // SYSCALL mode, calls to patch once the flush routine is placed
+		};
+
+		/******************************************************************************/
+		void emitX64(const std::vector<Op>& program, const X64Options& options, X64Code& out)
+		{
+			X64Emitter(program, options, out).emit();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "bfir.h"
+
+
+
+namespace p95
+{
+	namespace bf
+	{
+		/* State shared between the host and generated code. Field offsets are baked into
+		* the emitted instructions, so generated code is only valid for this exact layout. */
+		struct JitFrame
+		{
+			char* cell;			// in/out: cell pointed by DP
+			char* lo;			// First data memory cell
+			char* hi;			// Last data memory cell
+			void* ctx;
+			int (*put)(void* ctx, char value);		// Returns non-zero to suspend before the op
+			int (*get)(void* ctx, char* cell);		// Returns non-zero to suspend before the op
+			size_t (*scan)(const char* memory, size_t size, size_t pos, int stride);
+			const void* entry;	// Code address to start at, see X64Code::opOffsets
+			unsigned int exitOp;	// out: op to resume at, or op count when halted
+		};
+
+		enum class X64Io
+		{
+			CALLBACK,	// Hosted: "void fn(JitFrame*)", I/O through frame callbacks
+			SYSCALL,	// Standalone: entry point of a static Linux executable, raw read/write/exit syscalls
+		};
+
+		struct X64Options
+		{
+			bool boundsChecks = true;	// Clamp DP and offset accesses to [lo, hi]
+			X64Io io = X64Io::CALLBACK;
+
+			/* SYSCALL only, absolute addresses of the zeroed tape and output buffer */
+			unsigned long long tapeAddress = 0;
+			unsigned long long tapeSize = 0;
+			unsigned long long outBufferAddress = 0;
+		};
+
+		/* Output of standalone code is flushed when this fills up, before each read and at exit */
+		static const unsigned int X64_OUT_BUFFER_SIZE = 4096;
+
+		struct X64Code
+		{
+			std::vector<unsigned char> bytes;
+			std::vector<unsigned int> opOffsets;	// Code offset of each op, plus one for the end of the program
+		};
+
+		/******************************************************************************/
+		/* Emits x86-64 (System V) code for the IR. In CALLBACK mode the code is a single function
+		* "void fn(JitFrame* frame)" that jumps to frame->entry after the prologue; in SYSCALL
+		* mode it starts at offset 0 and never returns. */
+		void emitX64(const std::vector<Op>& program, const X64Options& options, X64Code& out);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "elfwriter.h"
+
+#include <fstream>
+
+#if !defined(_WIN32)
+	#include <sys/stat.h>
+#endif
+
+
+
+namespace p95
+{
+	namespace bfc
+	{
+		static const unsigned int EHDR_SIZE = 64;
+		static const unsigned int PHDR_SIZE = 56;
+		static const unsigned int PHDR_COUNT = 2;
+		static const unsigned long long PAGE_SIZE = 0x1000;
+
+		static const unsigned int PF_X = 1;
+		static const unsigned int PF_W = 2;
+		static const unsigned int PF_R = 4;
+
+		/******************************************************************************/
+		class ByteWriter
+		{
+		public:
+
+			void u8(unsigned char v) { m_bytes.push_back(v); }
+			void u16(unsigned int v) { put(v, 2); }
+			void u32(unsigned int v) { put(v, 4); }
+			void u64(unsigned long long v) { put(v, 8); }
+
+			std::vector<unsigned char>& bytes() { return m_bytes; }
+
+		private:
+
+			void put(unsigned long long v, int size)
+			{
+				for(int i = 0; i < size; i++)
+					m_bytes.push_back((unsigned char)(v >> (i * 8)));
+			}
+
+		private:
+
+			std::vector<unsigned char> m_bytes;
+		};
+
+		static void writeProgramHeader(ByteWriter& out, unsigned int flags, unsigned long long vaddr,
+			unsigned long long fileSize, unsigned long long memSize)
+		{
+			out.u32(1);			// PT_LOAD
+			out.u32(flags);
+			out.u64(0);			// p_offset, both segments map from the start of the file
+			out.u64(vaddr);
+			out.u64(vaddr);
+			out.u64(fileSize);
+			out.u64(memSize);
+			out.u64(PAGE_SIZE);
+		}
+
+		/******************************************************************************/
+		unsigned long long codeAddress()
+		{
+			return ElfImage::TEXT_ADDRESS + EHDR_SIZE + PHDR_SIZE * PHDR_COUNT;
+		}
+
+		bool writeElf(const std::string& path, const ElfImage& image)
+		{
+			const unsigned long long _textSize = EHDR_SIZE + PHDR_SIZE * PHDR_COUNT + image.code.size();
+			ByteWriter _out;
+
+			/* ELF header */
+			for(unsigned char _c : { 0x7F, 0x45, 0x4C, 0x46, 2 /* 64-bit */, 1 /* LE */, 1 /* version */, 0 /* SysV */ }) // \x7F ELF
+				_out.u8(_c);
+			for(int i = 0; i < 8; i++)
+				_out.u8(0);
+			_out.u16(2);				// ET_EXEC
+			_out.u16(0x3E);				// EM_X86_64
+			_out.u32(1);
+			_out.u64(codeAddress());	// e_entry
+			_out.u64(EHDR_SIZE);		// e_phoff
+			_out.u64(0);				// e_shoff
+			_out.u32(0);
+			_out.u16(EHDR_SIZE);
+			_out.u16(PHDR_SIZE);
+			_out.u16(PHDR_COUNT);
+			_out.u16(0);
+			_out.u16(0);
+			_out.u16(0);
+
+			writeProgramHeader(_out, PF_R | PF_X, ElfImage::TEXT_ADDRESS, _textSize, _textSize);
+			writeProgramHeader(_out, PF_R | PF_W, ElfImage::BSS_ADDRESS, 0, image.bssSize);
+
+			_out.bytes().insert(_out.bytes().end(), image.code.begin(), image.code.end());
+
+			std::ofstream _file(path, std::ios::binary | std::ios::trunc);
+			if(!_file)
+				return false;
+			_file.write((const char*)_out.bytes().data(), (std::streamsize)_out.bytes().size());
+			_file.close();
+			if(!_file)
+				return false;
+
+#if !defined(_WIN32)
+			chmod(path.c_str(), 0755);
+#endif
+			return true;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+
+namespace p95
+{
+	namespace bfc
+	{
+		struct ElfImage
+		{
+			std::vector<unsigned char> code;	// Entry point at offset 0
+			unsigned long long bssSize;			// Zeroed RW memory at ElfImage::BSS_ADDRESS
+
+			static const unsigned long long TEXT_ADDRESS = 0x400000;
+			static const unsigned long long BSS_ADDRESS = 0x10000000;
+		};
+
+		/******************************************************************************/
+		/* Virtual address the code will be loaded at, known before the code is emitted */
+		unsigned long long codeAddress();
+
+		/* Writes a static x86-64 Linux executable with a RX text and a RW bss segment */
+		bool writeElf(const std::string& path, const ElfImage& image);
+	}
+}
\ No newline at end of file
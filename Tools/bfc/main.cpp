@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bfir.h"
+#include "bfx64.h"
+#include "elfwriter.h"
+
+
+
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: bfc [options] <source.bf | ->\n"
+		"Compiles Brainfuck into a static x86-64 Linux executable.\n\n"
+		"  -o <file>            Output path (default: a.out)\n"
+		"  -m <cells>           Tape size in cells (default: 30000)\n"
+		"  --no-bounds-checks   Don't clamp the data pointer to the tape\n");
+}
+
+int main(int argc, char** argv)
+{
+	using namespace p95;
+
+	std::string _inputPath;
+	std::string _outputPath = "a.out";
+	unsigned long long _tapeSize = 30000;
+	bool _boundsChecks = true;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			_outputPath = argv[++i];
+		else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			_tapeSize = strtoull(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "--no-bounds-checks") == 0)
+			_boundsChecks = false;
+		else if(argv[i][0] == '-' && argv[i][1] != '\0')
+		{
+			printUsage();
+			return 2;
+		}
+		else
+			_inputPath = argv[i];
+	}
+
+	if(_inputPath.empty() || _tapeSize == 0)
+	{
+		printUsage();
+		return 2;
+	}
+
+	/* Read source */
+	std::stringstream _source;
+	if(_inputPath == "-")
+		_source << std::cin.rdbuf();
+	else
+	{
+		std::ifstream _file(_inputPath, std::ios::binary);
+		if(!_file)
+		{
+			fprintf(stderr, "bfc: can't open %s\n", _inputPath.c_str());
+			return 1;
+		}
+		_source << _file.rdbuf();
+	}
+
+	std::string _progMem = bf::stripSource(_source.str());
+	std::vector<unsigned int> _jumpTable;
+	if(!bf::matchBrackets(_progMem, _jumpTable))
+	{
+		fprintf(stderr, "bfc: unbalanced brackets\n");
+		return 1;
+	}
+
+	/* Lower and optimise */
+	std::vector<bf::Op> _program = bf::compileProgram(_progMem);
+	bf::optimizeIdioms(_program, bf::Dialect(), (size_t)_tapeSize);
+	bf::optimizeOffsets(_program);
+
+	/* Tape first, output buffer right after it, both in bss */
+	bf::X64Options _options;
+	_options.io = bf::X64Io::SYSCALL;
+	_options.boundsChecks = _boundsChecks;
+	_options.tapeAddress = bfc::ElfImage::BSS_ADDRESS;
+	_options.tapeSize = _tapeSize;
+	_options.outBufferAddress = (bfc::ElfImage::BSS_ADDRESS + _tapeSize + 15) & ~15ull;
+
+	bf::X64Code _code;
+	bf::emitX64(_program, _options, _code);
+
+	bfc::ElfImage _image;
+	_image.code.swap(_code.bytes);
+	_image.bssSize = _options.outBufferAddress - bfc::ElfImage::BSS_ADDRESS + bf::X64_OUT_BUFFER_SIZE;
+
+	if(!bfc::writeElf(_outputPath, _image))
+	{
+		fprintf(stderr, "bfc: can't write %s\n", _outputPath.c_str());
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
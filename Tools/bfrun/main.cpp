@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bfbatch.h"
+#include "bfsim.h"
+
+
+
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: bfrun [options] <source.bf | ->\n"
+		"       bfrun -j <threads> [options] [-i <input>]... <source.bf>...\n"
+		"Runs Brainfuck on the simulator core, program I/O goes through stdin/stdout.\n\n"
+		"  -e <engine>          stepping, ir, threaded, jit, native or tiered (default: threaded)\n"
+		"  -m <cells>           Tape size in cells, the limit with --edge grow (default: 30000)\n"
+		"  -c <bits>            Cell width: 8, 16, 32 or 64 (default: 8)\n"
+		"  --saturate           Cells stop at 0 and their maximum instead of wrapping\n"
+		"  --eof <mode>         What \",\" stores at end of input: unchanged, zero or all-ones\n"
+		"  --edge <mode>        Moving past the tape: clamp, error, wrap or grow (default: clamp)\n"
+		"                       Dialects other than the default run on the threaded engine\n"
+		"  --guard              Tape between guard pages, faster with --edge error when\n"
+		"                       the tape is whole pages (4096 cells of 8 bits, say)\n"
+		"  --prefix <ticks>     Run up to that many ops ahead at load, until the first input\n"
+		"  -s, --stats          Print engine, tick count and run time to stderr\n"
+		"  -j <threads>         Batch mode: run every source against every input on a thread pool,\n"
+		"                       0 uses all cores. Outputs go to stdout in order, sources outer\n"
+		"  -i <input>           Batch input file, repeatable (default: stdin, read once)\n");
+}
+
+static bool parseEngine(const char* name, p95::bf::Engine& engine)
+{
+	using p95::bf::Engine;
+
+	static const struct { const char* name; Engine engine; } ENGINES[] = {
+		{ "stepping", Engine::STEPPING },
+		{ "ir", Engine::IR },
+		{ "threaded", Engine::THREADED },
+		{ "jit", Engine::JIT },
+		{ "native", Engine::NATIVE },
+		{ "tiered", Engine::TIERED },
+	};
+
+	for(const auto& _entry : ENGINES)
+	{
+		if(strcmp(name, _entry.name) == 0)
+		{
+			engine = _entry.engine;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parseEofMode(const char* name, p95::bf::EofMode& mode)
+{
+	using p95::bf::EofMode;
+
+	for(EofMode _mode : { EofMode::UNCHANGED, EofMode::ZERO, EofMode::ALL_ONES })
+	{
+		if(strcmp(name, p95::bf::eofModeToStr(_mode)) == 0)
+		{
+			mode = _mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parseTapeEdge(const char* name, p95::bf::TapeEdge& edge)
+{
+	using p95::bf::TapeEdge;
+
+	for(TapeEdge _edge : { TapeEdge::CLAMP, TapeEdge::ERROR, TapeEdge::WRAP, TapeEdge::GROW })
+	{
+		if(strcmp(name, p95::bf::tapeEdgeToStr(_edge)) == 0)
+		{
+			edge = _edge;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool readFile(const std::string& path, std::string& data)
+{
+	std::stringstream _data;
+	if(path == "-")
+		_data << std::cin.rdbuf();
+	else
+	{
+		std::ifstream _file(path, std::ios::binary);
+		if(!_file)
+		{
+			fprintf(stderr, "bfrun: can't open %s\n", path.c_str());
+			return false;
+		}
+		_data << _file.rdbuf();
+	}
+	data = _data.str();
+	return true;
+}
+
+static int runBatch(const std::vector<std::string>& sourcePaths, const std::vector<std::string>& inputPaths,
+	p95::bf::Engine engine, const p95::bf::Dialect& dialect, long tapeSize, bool guard, size_t prefixTicks, unsigned int threads, bool stats)
+{
+	using namespace p95;
+
+	/* Every program is built and every input read once, jobs share them */
+	std::vector<std::shared_ptr<const bf::Program>> _programs;
+	for(const std::string& _path : sourcePaths)
+	{
+		std::string _source;
+		if(!readFile(_path, _source))
+			return 1;
+		_programs.push_back(bf::Program::build(_source, engine, dialect, prefixTicks, (size_t)tapeSize));
+		if(!_programs.back())
+		{
+			fprintf(stderr, "bfrun: unbalanced brackets in %s\n", _path.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<std::shared_ptr<const std::string>> _inputs;
+	for(const std::string& _path : inputPaths)
+	{
+		std::string _input;
+		if(!readFile(_path, _input))
+			return 1;
+		_inputs.push_back(std::make_shared<const std::string>(std::move(_input)));
+	}
+
+	bf::BatchRunner _runner((int)tapeSize, threads, guard);
+	for(const auto& _program : _programs)
+	{
+		for(const auto& _input : _inputs)
+			_runner.submit({ _program, _input, bf::RunLimits() });
+	}
+
+	const auto _start = std::chrono::steady_clock::now();
+	std::vector<bf::BatchResult> _results = _runner.run();
+	const auto _end = std::chrono::steady_clock::now();
+
+	bf::FdSink _output(STDOUT_FILENO);
+	for(const bf::BatchResult& _result : _results)
+		_output.write(_result.output.data(), _result.output.size());
+
+	if(stats)
+	{
+		size_t _ticks = 0;
+		for(const bf::BatchResult& _result : _results)
+			_ticks += _result.ticks;
+
+		fprintf(stderr, "engine: %s\n", bf::engineToStr(_programs[0]->getEngine()));
+		fprintf(stderr, "jobs: %zu on %u threads\n", _results.size(), _runner.getThreadCount());
+		fprintf(stderr, "ticks: %zu\n", _ticks);
+		fprintf(stderr, "time: %.3f ms\n", std::chrono::duration<double, std::milli>(_end - _start).count());
+	}
+
+	if(_output.hasFailed())
+	{
+		fprintf(stderr, "bfrun: can't write output\n");
+		return 1;
+	}
+
+	int _status = 0;
+	for(size_t i = 0; i < _results.size(); i++)
+	{
+		if(_results[i].result.reason != bf::StopReason::HALTED)
+		{
+			fprintf(stderr, "bfrun: job %zu: %s\n", i, bf::stopReasonToStr(_results[i].result.reason));
+			_status = 1;
+		}
+	}
+	return _status;
+}
+
+int main(int argc, char** argv)
+{
+	using namespace p95;
+
+	std::vector<std::string> _sourcePaths;
+	std::vector<std::string> _inputPaths;
+	bf::Engine _engine = bf::Engine::THREADED;
+	bf::Dialect _dialect;
+	long _tapeSize = 30000;
+	bool _stats = false;
+	bool _guard = false;
+	long long _prefixTicks = 0;
+	bool _batch = false;
+	long _threads = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+		{
+			if(!parseEngine(argv[++i], _engine))
+			{
+				printUsage();
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			_tapeSize = strtol(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+		{
+			_dialect.cellBits = (unsigned int)strtoul(argv[++i], nullptr, 10);
+			if(_dialect.cellBits != 8 && _dialect.cellBits != 16 && _dialect.cellBits != 32 && _dialect.cellBits != 64)
+			{
+				printUsage();
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "--saturate") == 0)
+			_dialect.overflow = bf::Overflow::SATURATE;
+		else if(strcmp(argv[i], "--eof") == 0 && i + 1 < argc)
+		{
+			if(!parseEofMode(argv[++i], _dialect.eof))
+			{
+				printUsage();
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "--edge") == 0 && i + 1 < argc)
+		{
+			if(!parseTapeEdge(argv[++i], _dialect.edge))
+			{
+				printUsage();
+				return 2;
+			}
+		}
+		else if(strcmp(argv[i], "--guard") == 0)
+			_guard = true;
+		else if(strcmp(argv[i], "--prefix") == 0 && i + 1 < argc)
+			_prefixTicks = strtoll(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stats") == 0)
+			_stats = true;
+		else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			_batch = true;
+			_threads = strtol(argv[++i], nullptr, 10);
+		}
+		else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+			_inputPaths.push_back(argv[++i]);
+		else if(argv[i][0] == '-' && argv[i][1] != '\0')
+		{
+			printUsage();
+			return 2;
+		}
+		else
+			_sourcePaths.push_back(argv[i]);
+	}
+
+	if(_sourcePaths.empty() || _tapeSize <= 0 || _tapeSize > 0x7FFFFFFF || _threads < 0 || _prefixTicks < 0 ||
+		(!_batch && (_sourcePaths.size() > 1 || !_inputPaths.empty())))
+	{
+		printUsage();
+		return 2;
+	}
+
+	if(_batch)
+	{
+		if(_inputPaths.empty())
+			_inputPaths.push_back("-");
+		return runBatch(_sourcePaths, _inputPaths, _engine, _dialect, _tapeSize, _guard, (size_t)_prefixTicks, (unsigned int)_threads, _stats);
+	}
+
+	/* Read source. From stdin, the program itself then sees EOF on its input */
+	std::string _source;
+	if(!readFile(_sourcePaths[0], _source))
+		return 1;
+
+	bf::SimConfig _config = {};
+	_config.engine = _engine;
+	_config.dialect = _dialect;
+	_config.maxDataMemorySize = (int)_tapeSize;
+	_config.guardedTape = _guard;
+	_config.prefixTicks = (size_t)_prefixTicks;
+
+	bf::BF_Machine _machine;
+	_machine.init(&_config);
+	if(!_machine.parseSource(_source))
+	{
+		fprintf(stderr, "bfrun: unbalanced brackets\n");
+		return 1;
+	}
+	_machine.setState(bf::MachineState::RUNNING);
+
+	/* Output is written when the machine's buffer fills, before every read and at halt */
+	bf::FdSource _input(STDIN_FILENO);
+	bf::FdSink _output(STDOUT_FILENO);
+	_machine.setInputSource(&_input);
+	_machine.setOutputSink(&_output);
+	_machine.setLineBuffered(isatty(STDOUT_FILENO) != 0); // Interactive, show each line as it's done
+
+	const auto _start = std::chrono::steady_clock::now();
+	bf::RunResult _result = _machine.runUntilHalt();
+	const auto _end = std::chrono::steady_clock::now();
+
+	if(_stats)
+	{
+		fprintf(stderr, "engine: %s\n", bf::engineToStr(_machine.getEngine()));
+		fprintf(stderr, "ticks: %zu\n", _machine.getTicks()); // Ticks the prefix skipped included
+		fprintf(stderr, "time: %.3f ms\n", std::chrono::duration<double, std::milli>(_end - _start).count());
+	}
+
+	if(_result.reason == bf::StopReason::TAPE_FAULT)
+	{
+		_machine.flushStdOut(); // What it wrote before going past the tape
+		fprintf(stderr, "bfrun: tape fault at data pointer %u\n", _machine.getDataPtr());
+		return 1;
+	}
+	if(_result.reason != bf::StopReason::HALTED || _output.hasFailed())
+	{
+		fprintf(stderr, "bfrun: can't write output\n");
+		return 1;
+	}
+	return 0;
+}
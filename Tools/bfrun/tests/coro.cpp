@@ -0,0 +1,148 @@
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bfcoro.h"
+
+#if !defined(BF_COROUTINES_AVAILABLE)
+	#error "tests/coro needs C++20 coroutines"
+#endif
+
+/* Multiplexes many coroutine executions on one thread. Input arrives a byte per wait, output
+* is only taken once the buffer fills and long loops yield after a tick slice. Each run has to
+* end with what a plain run prints. */
+
+
+
+using namespace p95::bf;
+
+namespace
+{
+	struct Case
+	{
+		const char* name;
+		std::string source;
+		std::string input;
+		size_t sliceTicks;
+	};
+
+	const Case CASES[] = {
+		{ "echo", ",----------[++++++++++.,----------]", "coroutines share one thread\n", 0 },
+		{ "flood", std::string(65, '+') + ">++++++++[>++++++++++[>++++++++++[>++++++++++[>++++++++++[<<<<<.>>>>>-]<-]<-]<-]<-]", "", 0 },
+		{ "sliced", "+++[>+++++[>+++++++[>+++++++++[>+>+<<-]>>[<<+>>-]<<<-]<-]<-]>>>>.", "", 100 },
+	};
+
+	const Engine ENGINES[] = { Engine::IR, Engine::THREADED, Engine::JIT };
+
+	const int MACHINES = 8;
+
+	void drain(BF_Machine& machine, std::string& output)
+	{
+		const char* _data;
+		size_t _size;
+		while((_size = machine.peekStdOut(&_data)) > 0)
+		{
+			output.append(_data, _size);
+			machine.consumeStdOut(_size);
+		}
+	}
+
+	/* What a plain run prints, with all input there from the start */
+	std::string plainOutput(SimConfig* config, const Case& test)
+	{
+		BF_Machine _machine;
+		_machine.init(config);
+		_machine.parseSource(test.source);
+		_machine.writeToStdInBuffer(test.input);
+		_machine.closeStdIn();
+		_machine.setState(MachineState::RUNNING);
+
+		std::string _output;
+		while(_machine.runUntilHalt().reason == StopReason::OUTPUT_FULL)
+			drain(_machine, _output);
+		drain(_machine, _output);
+		return _output;
+	}
+
+	/* Resumes every execution in turn until all are done. Returns the mismatches */
+	int interleave(SimConfig* config, const Case& test, size_t& waits)
+	{
+		const std::string _expected = plainOutput(config, test);
+
+		std::unique_ptr<BF_Machine[]> _machines(new BF_Machine[MACHINES]);
+		std::vector<Execution> _executions;
+		std::vector<std::string> _outputs(MACHINES);
+		std::vector<size_t> _fed(MACHINES, 0);
+		for(int i = 0; i < MACHINES; i++)
+		{
+			_machines[i].init(config);
+			_machines[i].parseSource(test.source);
+			_machines[i].setState(MachineState::RUNNING);
+			_executions.push_back(execute(_machines[i], test.sliceTicks));
+		}
+
+		for(bool _running = true; _running;)
+		{
+			_running = false;
+			for(int i = 0; i < MACHINES; i++)
+			{
+				if(!_executions[i].resume())
+					continue;
+				_running = true;
+				waits++;
+
+				switch(_executions[i].getWaitReason())
+				{
+					case StopReason::INPUT_NEEDED:
+						if(_fed[i] < test.input.size())
+							_fed[i] += _machines[i].feedStdIn(test.input.data() + _fed[i], 1);
+						else
+							_machines[i].closeStdIn();
+						break;
+					case StopReason::OUTPUT_FULL:
+						drain(_machines[i], _outputs[i]);
+						break;
+					default:
+						break;
+				}
+			}
+		}
+
+		int _failures = 0;
+		for(int i = 0; i < MACHINES; i++)
+		{
+			drain(_machines[i], _outputs[i]);
+			if(_executions[i].getWaitReason() != StopReason::HALTED || _outputs[i] != _expected)
+				_failures++;
+		}
+		return _failures;
+	}
+}
+
+int main()
+{
+	int _failed = 0;
+	for(Engine _engine : ENGINES)
+	{
+		SimConfig _config = {};
+		_config.engine = _engine;
+		_config.maxDataMemorySize = 30000;
+
+		for(const Case& _case : CASES)
+		{
+			size_t _waits = 0;
+			const int _failures = interleave(&_config, _case, _waits);
+			printf("%-9s %-7s %d executions, %zu waits: %d mismatched\n", engineToStr(_engine), _case.name, MACHINES, _waits, _failures);
+
+			/* Every case has to suspend, or it didn't test anything. JIT code doesn't count ticks,
+			* it only yields on I/O */
+			const bool _yields = _case.sliceTicks == 0 || _engine != Engine::JIT;
+			if(_failures > 0 || (_yields && _waits == 0))
+				_failed++;
+		}
+	}
+
+	return _failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,422 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bfsim.h"
+
+/* Runs programs on the optimising engines and compares output, final state, tape and DP
+* with a plain one-instruction-at-a-time reference. Random programs across every dialect
+* cover the IR passes, listed cases pin down edge behaviour that went wrong before. */
+
+
+
+using namespace p95::bf;
+
+namespace
+{
+	const size_t MAX_STEPS = 200000;
+
+	struct Outcome
+	{
+		MachineState state;		// RUNNING when the step or tick limit ran out
+		std::string output;
+		std::map<long long, uint64_t> cells;	// Non-zero cells by position relative to DP
+		long long dp;			// Absolute DP, unused under GROW where the tape moves
+		size_t ticks;			// What the machine counted, 0 from the reference
+	};
+
+	struct Case
+	{
+		std::string source;
+		TapeEdge edge;
+		int cells;
+		const char* input;
+	};
+
+	/* Regression cases, classic cells under the given edge */
+	const Case CASES[] = {
+		{ "++++[>+++[>++<-]<-]>>.", TapeEdge::CLAMP, 16, "" },
+		{ "+++[>,.<-]>[-]>>+<[-]>.", TapeEdge::CLAMP, 16, "abc" },
+		{ ">+<[>[-]<-]>[.]+.", TapeEdge::CLAMP, 16, "" },
+		{ "+<>.", TapeEdge::CLAMP, 16, "" },
+		{ "+<>.", TapeEdge::ERROR, 16, "" },
+		{ "<<<->>>.", TapeEdge::CLAMP, 16, "" },
+		{ "+>>>>+<<.", TapeEdge::CLAMP, 3, "" },
+		{ "-<<<[[<+<<>>]<<<---->][++++++++++----]++++---[++>>>,<<]+++++++++.++++", TapeEdge::CLAMP, 30000, "" },
+		{ "+[<>-]", TapeEdge::ERROR, 16, "" },
+		{ ">>[->+<]", TapeEdge::ERROR, 3, "" },
+		{ ">>[->+<]+.", TapeEdge::GROW, 3, "" },
+		{ "<+.", TapeEdge::GROW, 64, "" },
+		{ std::string(4100, '>') + "+" + std::string(4101, '<') + "+.", TapeEdge::GROW, 8000, "" },
+		{ "+[>+]", TapeEdge::GROW, 5000, "" },
+		{ "+[<+]", TapeEdge::GROW, 5000, "" },
+		{ ">>>>>>>>>>>>>>>>+.", TapeEdge::ERROR, 16, "" },
+		{ "+[>+]", TapeEdge::ERROR, 4096, "" },
+		{ ">+[<+]", TapeEdge::ERROR, 4096, "" },
+		{ ">>>+>>>>[-.]", TapeEdge::CLAMP, 4, "" },
+		{ ">>[>]+>>[-+,+++[<][<.-]]-", TapeEdge::CLAMP, 3, "a" },
+		{ ">>+++[->+<]>.", TapeEdge::CLAMP, 3, "" },
+	};
+
+	/* Steps one instruction at a time, moving past the tape's end as the dialect says. GROW
+	* faults once the cells visited span more than "cells". */
+	Outcome reference(const std::string& source, const Dialect& dialect, int cells, const std::string& input)
+	{
+		std::vector<size_t> _jumps(source.size());
+		std::vector<size_t> _open;
+		for(size_t i = 0; i < source.size(); i++)
+		{
+			if(source[i] == '[')
+				_open.push_back(i);
+			else if(source[i] == ']')
+			{
+				_jumps[i] = _open.back();
+				_jumps[_open.back()] = i;
+				_open.pop_back();
+			}
+		}
+
+		const uint64_t _max = dialect.cellBits == 64 ? ~0ull : (1ull << dialect.cellBits) - 1;
+		const bool _wrap = dialect.overflow == Overflow::WRAP;
+
+		Outcome _outcome = { MachineState::RUNNING, std::string(), {}, 0, 0 };
+		std::map<long long, uint64_t> _tape;
+		long long _dp = 0, _low = 0, _high = 0;
+		size_t _ip = 0, _input = 0;
+
+		for(size_t _step = 0; _step < MAX_STEPS && _outcome.state == MachineState::RUNNING; _step++)
+		{
+			if(_ip >= source.size())
+			{
+				_outcome.state = MachineState::HALTED;
+				break;
+			}
+
+			uint64_t& _cell = _tape[_dp];
+			switch(source[_ip])
+			{
+				case '+': _cell = _wrap ? (_cell + 1) & _max : (_cell < _max ? _cell + 1 : _cell); break;
+				case '-': _cell = _wrap ? (_cell - 1) & _max : (_cell > 0 ? _cell - 1 : _cell); break;
+				case '.': _outcome.output.push_back((char)_cell); break;
+				case ',':
+					if(_input < input.size())
+						_cell = (unsigned char)input[_input++];
+					else if(dialect.eof == EofMode::ZERO)
+						_cell = 0;
+					else if(dialect.eof == EofMode::ALL_ONES)
+						_cell = _max;
+					break;
+				case '[':
+					if(_cell == 0)
+						_ip = _jumps[_ip];
+					break;
+				case ']':
+					if(_cell != 0)
+						_ip = _jumps[_ip];
+					break;
+				case '>':
+				case '<':
+				{
+					const long long _next = _dp + (source[_ip] == '>' ? 1 : -1);
+					if(dialect.edge == TapeEdge::GROW)
+					{
+						if((_next > _high ? _next : _high) - (_next < _low ? _next : _low) + 1 > cells)
+							_outcome.state = MachineState::FAULTED;
+						else
+						{
+							_dp = _next;
+							_low = _dp < _low ? _dp : _low;
+							_high = _dp > _high ? _dp : _high;
+						}
+					}
+					else if(_next >= 0 && _next < cells)
+						_dp = _next;
+					else if(dialect.edge == TapeEdge::WRAP)
+						_dp = (_next + cells) % cells;
+					else if(dialect.edge == TapeEdge::ERROR)
+						_outcome.state = MachineState::FAULTED;
+					break;
+				}
+			}
+			_ip++;
+		}
+
+		for(const auto& _entry : _tape)
+		{
+			if(_entry.second != 0)
+				_outcome.cells[_entry.first - _dp] = _entry.second;
+		}
+		_outcome.dp = _dp;
+		return _outcome;
+	}
+
+	/* Runs until halt, fault or the tick limit. Engines that don't count ticks only run after
+	* the threaded engine halted on the same program, they have no limit to stop them. With
+	* "builtFor" the program is built for a tape that long and loaded onto this one. */
+	Outcome run(const std::string& source, Engine engine, const Dialect& dialect, int cells, const std::string& input, size_t prefixTicks, size_t builtFor, bool guarded)
+	{
+		SimConfig _config = {};
+		_config.engine = engine;
+		_config.maxDataMemorySize = cells;
+		_config.dialect = dialect;
+		_config.prefixTicks = prefixTicks;
+		_config.guardedTape = guarded;
+
+		BF_Machine _machine;
+		_machine.init(&_config);
+		if(builtFor != 0)
+			_machine.loadProgram(Program::build(source, engine, dialect, prefixTicks, builtFor));
+		else
+			_machine.parseSource(source);
+		_machine.writeToStdInBuffer(input);
+		_machine.closeStdIn();
+		_machine.setState(MachineState::RUNNING);
+
+		MemorySink _sink;
+		_machine.setOutputSink(&_sink);
+		_machine.runFor(MAX_STEPS * 2);
+
+		/* A fault leaves output in the machine's buffer */
+		Outcome _outcome = { _machine.getState(), _sink.getData() + _machine.getStdOut(), {}, (long long)_machine.getDataPtr(), _machine.getTicks() };
+		const size_t _cellSize = _machine.getCellSize();
+		const char* _memory = _machine.getDataMemory();
+		for(size_t i = 0; i < _machine.getDataMemoSize(); i++)
+		{
+			uint64_t _value = 0;
+			memcpy(&_value, _memory + i * _cellSize, _cellSize);
+			if(_value != 0)
+				_outcome.cells[(long long)i - _outcome.dp] = _value;
+		}
+		return _outcome;
+	}
+
+	/* Empty when they agree. The tape only counts once both halted, a faulted run may
+	* stop part way through a folded op. */
+	std::string compare(const Outcome& expected, const Outcome& actual, TapeEdge edge)
+	{
+		if(actual.state != expected.state)
+			return std::string("state ") + stateToStr(actual.state) + ", expected " + stateToStr(expected.state);
+		if(actual.output != expected.output)
+			return "output differs";
+		if(expected.state != MachineState::HALTED)
+			return std::string();
+		if(edge != TapeEdge::GROW && actual.dp != expected.dp)
+			return "DP " + std::to_string(actual.dp) + ", expected " + std::to_string(expected.dp);
+		if(actual.cells != expected.cells)
+			return "tape differs";
+		return std::string();
+	}
+
+	/* Loops nest up to three deep, scans and clear-style loops included */
+	std::string randomBody(std::mt19937& rng, int depth)
+	{
+		static const char* const SCANS[] = { "[>]", "[<]", "[>>]", "[<<<]" };
+		static const char* const CHARS = "++--<>>.,";
+
+		std::string _body;
+		const int _length = 1 + rng() % 12;
+		for(int i = 0; i < _length; i++)
+		{
+			if(rng() % 100 < 8)
+				_body += SCANS[rng() % 4];
+			else if(rng() % 100 < 15 && depth < 3)
+				_body += rng() % 2 ? "[" + randomBody(rng, depth + 1) + "-]" : "[-" + randomBody(rng, depth + 1) + "]";
+			else
+				_body += CHARS[rng() % 9];
+		}
+		return _body;
+	}
+
+	const char* describe(const Dialect& dialect)
+	{
+		static char _text[64];
+		snprintf(_text, sizeof(_text), "%u-bit %s, eof %s, edge %s", dialect.cellBits, overflowToStr(dialect.overflow), eofModeToStr(dialect.eof), tapeEdgeToStr(dialect.edge));
+		return _text;
+	}
+
+	/* Checks one program on every engine the dialect runs on, prints and counts mismatches.
+	* Runs the reference doesn't finish within MAX_STEPS are skipped. */
+	int check(const std::string& source, const Dialect& dialect, int cells, const std::string& input, size_t prefixTicks, size_t builtFor, bool compiled, size_t& compared)
+	{
+		const Outcome _expected = reference(source, dialect, cells, input);
+		if(_expected.state == MachineState::RUNNING)
+			return 0;
+		compared++;
+
+		std::vector<Engine> _engines = { Engine::THREADED };
+		if(dialect.isClassic())
+		{
+			_engines.insert(_engines.begin(), { Engine::STEPPING, Engine::IR });
+			if(compiled)
+				_engines.insert(_engines.end(), { Engine::JIT, Engine::TIERED, Engine::NATIVE });
+		}
+
+		int _failures = 0;
+		for(Engine _engine : _engines)
+		{
+			const bool _counted = _engine == Engine::STEPPING || _engine == Engine::IR || _engine == Engine::THREADED;
+			if(!_counted && _failures > 0)
+				break;
+
+			const std::string _error = compare(_expected, run(source, _engine, dialect, cells, input, prefixTicks, builtFor, false), dialect.edge);
+			if(!_error.empty())
+			{
+				printf("  %s on %s, %d cells, prefix %zu, built for %zu: %s\n    %s\n", engineToStr(_engine), describe(dialect), cells, prefixTicks, builtFor, _error.c_str(), source.c_str());
+				_failures++;
+			}
+		}
+
+		/* Guard pages only change how the threaded engine finds the tape's ends */
+		if(dialect.edge == TapeEdge::ERROR || dialect.edge == TapeEdge::GROW)
+		{
+			const std::string _error = compare(_expected, run(source, Engine::THREADED, dialect, cells, input, prefixTicks, builtFor, true), dialect.edge);
+			if(!_error.empty())
+			{
+				printf("  Guarded on %s, %d cells, prefix %zu, built for %zu: %s\n    %s\n", describe(dialect), cells, prefixTicks, builtFor, _error.c_str(), source.c_str());
+				_failures++;
+			}
+		}
+		return _failures;
+	}
+
+	/* A prefix only moves where a run starts: with and without one, a counted engine ends with
+	* the same output, DP, tape and tick count. Returns the mismatches */
+	int checkPrefix()
+	{
+		static const char* const SOURCES[] = {
+			"++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.",
+			"++++[>+++[>++<-]<-]>>.,[.[-],]",
+			"+++++[>+++++<-]>[>+>+<<-]<+[>]<.",
+		};
+
+		int _failures = 0;
+		Dialect _dialect;
+		for(Engine _engine : { Engine::IR, Engine::THREADED, Engine::TIERED })
+		{
+			for(const char* _source : SOURCES)
+			{
+				const Outcome _plain = run(_source, _engine, _dialect, 300, "ab", 0, 0, false);
+				for(size_t _prefix : { (size_t)10, (size_t)100000 })
+				{
+					const Outcome _prefixed = run(_source, _engine, _dialect, 300, "ab", _prefix, 0, false);
+					std::string _error = compare(_plain, _prefixed, _dialect.edge);
+					if(_error.empty() && _prefixed.ticks != _plain.ticks)
+						_error = std::to_string(_prefixed.ticks) + " ticks, expected " + std::to_string(_plain.ticks);
+					if(!_error.empty())
+					{
+						printf("  %s, prefix %zu: %s\n    %s\n", engineToStr(_engine), _prefix, _error.c_str(), _source);
+						_failures++;
+					}
+				}
+			}
+		}
+		return _failures;
+	}
+
+	/* Loading over a finished run starts the new program at its first instruction, an empty
+	* one included. Returns the mismatches */
+	int checkReload()
+	{
+		int _failures = 0;
+		for(Engine _engine : { Engine::STEPPING, Engine::THREADED })
+		{
+			SimConfig _config = {};
+			_config.engine = _engine;
+			_config.maxDataMemorySize = 16;
+
+			BF_Machine _machine;
+			_machine.init(&_config);
+			_machine.parseSource(std::string(300, '+') + ".");
+			_machine.setState(MachineState::RUNNING);
+			MemorySink _before;
+			_machine.setOutputSink(&_before);
+			_machine.runUntilHalt();
+
+			for(const char* _source : { "-.", "" })
+			{
+				_machine.loadProgram(Program::build(_source, _engine));
+				_machine.setState(MachineState::RUNNING);
+				MemorySink _sink;
+				_machine.setOutputSink(&_sink);
+				const char _first = _machine.getCurrentInstruction();
+				_machine.runUntilHalt();
+				_machine.setOutputSink(nullptr);
+
+				if(_first != _source[0] || _machine.getState() != MachineState::HALTED || _sink.getData() != (*_source ? "\xff" : ""))
+				{
+					printf("  %s reloading \"%s\": starts at '%c', %s\n", engineToStr(_engine), _source, _first ? _first : '0', stateToStr(_machine.getState()));
+					_failures++;
+				}
+			}
+		}
+		return _failures;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const int _programs = argc > 1 ? atoi(argv[1]) : 3000;
+
+	int _failures = 0;
+	size_t _compared = 0;
+
+	for(const Case& _case : CASES)
+	{
+		Dialect _dialect;
+		_dialect.edge = _case.edge;
+		_failures += check(_case.source, _dialect, _case.cells, _case.input, 0, 0, true, _compared);
+		_failures += check(_case.source, _dialect, _case.cells, _case.input, 1000, 0, true, _compared);
+		_failures += check(_case.source, _dialect, _case.cells, _case.input, 0, 30000, true, _compared);
+	}
+	printf("%zu listed cases, %d mismatched\n", sizeof(CASES) / sizeof(CASES[0]), _failures);
+	const int _listedFailures = _failures;
+
+	static const unsigned int BITS[] = { 8, 16, 32, 64 };
+	static const size_t PREFIX[] = { 0, 50, 100000 };
+
+	std::mt19937 _rng;
+	const size_t _listed = _compared;
+	for(int i = 0; i < _programs; i++)
+	{
+		_rng.seed(i);
+
+		Dialect _dialect;
+		if(i % 5 != 0)
+		{
+			_dialect.cellBits = BITS[_rng() % 4];
+			_dialect.overflow = _rng() % 2 ? Overflow::SATURATE : Overflow::WRAP;
+			_dialect.eof = (EofMode)(_rng() % 3);
+			_dialect.edge = (TapeEdge)(_rng() % 4);
+		}
+
+		std::string _source = (_rng() % 2 ? ">>" : "") + randomBody(_rng, 0);
+		if(_rng() % 3 == 0)
+			_source = std::string(_rng() % 300, '+') + _source;
+
+		int _cells = _rng() % 2 ? 300 : 3 + _rng() % 10;
+		if(_dialect.edge == TapeEdge::WRAP || _dialect.edge == TapeEdge::ERROR)
+			_cells = 3 + _rng() % 10;
+		else if(_dialect.edge == TapeEdge::GROW)
+			_cells = 5000 + _rng() % 5000;
+
+		/* Compiling native code for each would take minutes, one in twenty is plenty */
+		_failures += check(_source, _dialect, _cells, "ab\xff\x01z", PREFIX[_rng() % 3], 0, i % 20 == 10, _compared);
+	}
+	printf("%zu random programs compared, %d mismatched\n", _compared - _listed, _failures - _listedFailures);
+
+	const int _prefixFailures = checkPrefix();
+	printf("With and without a prefix: %d mismatched\n", _prefixFailures);
+	_failures += _prefixFailures;
+
+	const int _reloadFailures = checkReload();
+	printf("Reloading a used machine: %d mismatched\n", _reloadFailures);
+	_failures += _reloadFailures;
+
+	return _failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "bfsim.h"
+
+/* What optimizeRanges() drops from a zeroed tape, and what it keeps on a CLAMP tape, given
+* its length. A program built for a longer tape gets rebuilt when it's loaded onto a shorter one. */
+
+
+
+using namespace p95::bf;
+
+namespace
+{
+	struct Case
+	{
+		const char* name;
+		const char* source;
+		size_t tapeCells;
+		size_t loops;	// JZ ops left
+		size_t clears;	// CLEAR ops left
+	};
+
+	const Case CASES[] = {
+		{ "comment", "[this loop never runs.]+.", 30000, 0, 0 },
+		{ "clears", "[-]>[-]<+[-][-].", 30000, 0, 1 },
+		{ "dead loop", "+[-]>[<+>-]<.", 30000, 0, 1 },
+		{ "runs once", "+[->+<]>.", 30000, 0, 1 },
+		{ "off the end", ">>>+>>>>[-.]", 4, 1, 0 },
+		{ "unknown end", ">>>+>>>>[-.]", 0, 1, 0 },
+		{ "on the tape", ">>>+>>>>[-.]", 30000, 0, 0 },
+	};
+
+	size_t count(const std::vector<Op>& ops, OpCode code)
+	{
+		size_t _count = 0;
+		for(const Op& _op : ops)
+		{
+			if(_op.code == code)
+				_count++;
+		}
+		return _count;
+	}
+
+	std::vector<Op> lower(const char* source, size_t tapeCells)
+	{
+		std::vector<Op> _ops = compileProgram(stripSource(source));
+		optimizeIdioms(_ops, Dialect(), tapeCells);
+		optimizeOffsets(_ops);
+		optimizeRanges(_ops, Dialect(), tapeCells);
+		optimizeOffsets(_ops);
+		return _ops;
+	}
+
+	/* Built for 30000 cells and loaded onto a 4-cell tape, the run has to print what stepping does */
+	int checkRebuild()
+	{
+		int _failures = 0;
+		for(Engine _engine : { Engine::STEPPING, Engine::IR, Engine::THREADED })
+		{
+			SimConfig _config = {};
+			_config.engine = _engine;
+			_config.maxDataMemorySize = 4;
+
+			BF_Machine _machine;
+			_machine.init(&_config);
+			_machine.loadProgram(Program::build(">>>+>>>>[-.]", _engine, Dialect(), 0, 30000));
+			_machine.setState(MachineState::RUNNING);
+			_machine.runUntilHalt();
+
+			if(_machine.getProgram()->getTapeCells() != 4 || _machine.getStdOut() != std::string(1, '\0'))
+			{
+				printf("  %s: built for %zu cells, printed %zu bytes\n", engineToStr(_engine), _machine.getProgram()->getTapeCells(), _machine.getStdOut().size());
+				_failures++;
+			}
+		}
+		return _failures;
+	}
+}
+
+int main()
+{
+	int _failures = 0;
+	for(const Case& _case : CASES)
+	{
+		const std::vector<Op> _ops = lower(_case.source, _case.tapeCells);
+		const size_t _loops = count(_ops, OpCode::JZ);
+		const size_t _clears = count(_ops, OpCode::CLEAR);
+		if(_loops != _case.loops || _clears != _case.clears)
+		{
+			printf("  %s, %zu cells: %zu loops and %zu clears, expected %zu and %zu\n", _case.name, _case.tapeCells, _loops, _clears, _case.loops, _case.clears);
+			_failures++;
+		}
+	}
+	printf("%zu programs lowered, %d mismatched\n", sizeof(CASES) / sizeof(CASES[0]), _failures);
+
+	const int _rebuildFailures = checkRebuild();
+	printf("Rebuilt for a shorter tape: %d mismatched\n", _rebuildFailures);
+	_failures += _rebuildFailures;
+
+	return _failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+
+#include "bfio.h"
+#include "bfsched.h"
+
+/* Round-robins machines on one Scheduler. Busy tasks get quantum * priority ticks a round,
+* tasks stopped on input leave the rotation until woken, and every task ends in the state
+* its program calls for. */
+
+
+
+using namespace p95::bf;
+
+namespace
+{
+	const size_t QUANTUM = 1000;
+	const int ROUNDS = 10;
+
+	/* Input that shows up only as the test hands it over */
+	struct Pipe
+	{
+		std::string data;
+		size_t read = 0;
+		bool closed = false;
+
+		long take(char* buffer, size_t size)
+		{
+			if(read == data.size())
+				return closed ? InputSource::END : 0;
+			const size_t _size = data.size() - read < size ? data.size() - read : size;
+			data.copy(buffer, _size, read);
+			read += _size;
+			return (long)_size;
+		}
+	};
+
+	void start(BF_Machine& machine, SimConfig* config, const std::string& source)
+	{
+		machine.init(config);
+		machine.parseSource(source);
+		machine.setState(MachineState::RUNNING);
+	}
+
+	/* Endless tasks of priority 1, 1 and 2 use exactly their slices, round after round */
+	int checkSlicing(SimConfig* config)
+	{
+		std::unique_ptr<BF_Machine[]> _machines(new BF_Machine[3]);
+		const unsigned int _priorities[] = { 1, 1, 2 };
+		Scheduler _scheduler(QUANTUM);
+		for(int i = 0; i < 3; i++)
+		{
+			start(_machines[i], config, "+[]");
+			_scheduler.add(_machines[i], _priorities[i]);
+		}
+
+		int _failures = 0;
+		for(int _round = 1; _round <= ROUNDS; _round++)
+		{
+			if(!_scheduler.runRound())
+				return _failures + 1;
+			for(int i = 0; i < 3; i++)
+			{
+				if(_scheduler.getState(i) != TaskState::READY || _scheduler.getTicksUsed(i) != _round * QUANTUM * _priorities[i])
+					_failures++;
+			}
+		}
+		return _failures;
+	}
+
+	/* A task waiting on input sits out rounds while others run, and echoes what arrived once woken */
+	int checkWaits(SimConfig* config)
+	{
+		BF_Machine _echo, _busy;
+		start(_echo, config, ",[.[-],]");
+		start(_busy, config, "+[]");
+
+		Pipe _pipe;
+		CallbackSource _source([&](char* buffer, size_t size) { return _pipe.take(buffer, size); });
+		MemorySink _sink;
+		_echo.setInputSource(&_source);
+		_echo.setOutputSink(&_sink);
+
+		Scheduler _scheduler(QUANTUM);
+		const size_t _echoTask = _scheduler.add(_echo);
+		const size_t _busyTask = _scheduler.add(_busy);
+
+		int _failures = 0;
+		_scheduler.runRound();
+		if(_scheduler.getState(_echoTask) != TaskState::WAITING || _scheduler.getReadyCount() != 1)
+			_failures++;
+
+		/* Asleep, it doesn't run however many rounds pass */
+		const size_t _asleep = _scheduler.getTicksUsed(_echoTask);
+		for(int i = 0; i < ROUNDS; i++)
+			_scheduler.runRound();
+		if(_scheduler.getTicksUsed(_echoTask) != _asleep || _scheduler.getTicksUsed(_busyTask) != (ROUNDS + 1) * QUANTUM)
+			_failures++;
+
+		for(const char* _chunk : { "round", " robin" })
+		{
+			_pipe.data += _chunk;
+			_scheduler.wake(_echoTask);
+			while(_scheduler.getState(_echoTask) == TaskState::READY)
+				_scheduler.runRound();
+			if(_scheduler.getState(_echoTask) != TaskState::WAITING)
+				_failures++;
+		}
+
+		_pipe.closed = true;
+		_scheduler.wake(_echoTask);
+		while(_scheduler.getState(_echoTask) == TaskState::READY)
+			_scheduler.runRound();
+		_echo.flushStdOut();
+		if(_scheduler.getState(_echoTask) != TaskState::HALTED || _sink.getData() != "round robin")
+			_failures++;
+		return _failures;
+	}
+
+	/* Tasks end halted, faulted or out of budget and leave the rotation, run() returns once
+	* none is ready */
+	int checkCompletion(SimConfig* config)
+	{
+		Dialect _error;
+		_error.edge = TapeEdge::ERROR;
+		SimConfig _errorConfig = *config;
+		_errorConfig.dialect = _error;
+
+		BF_Machine _done, _fault, _endless, _spent;
+		start(_done, config, "++++++++[>++++++++<-]>+.");
+		start(_fault, &_errorConfig, "+[<+]");
+		start(_endless, config, "+[]");
+		start(_spent, config, "+[]");
+
+		Scheduler _scheduler(QUANTUM);
+		const size_t _doneTask = _scheduler.add(_done);
+		const size_t _faultTask = _scheduler.add(_fault);
+		const size_t _endlessTask = _scheduler.add(_endless, 3, 5 * QUANTUM / 2);
+		const size_t _spentTask = _scheduler.add(_spent, 1, 0);
+		_scheduler.run();
+
+		int _failures = 0;
+		if(_scheduler.getState(_doneTask) != TaskState::HALTED || _done.getStdOut() != "A")
+			_failures++;
+		if(_scheduler.getState(_faultTask) != TaskState::FAULTED)
+			_failures++;
+		if(_scheduler.getState(_endlessTask) != TaskState::OUT_OF_BUDGET || _scheduler.getTicksUsed(_endlessTask) != 5 * QUANTUM / 2)
+			_failures++;
+		if(_scheduler.getState(_spentTask) != TaskState::OUT_OF_BUDGET || _scheduler.getTicksUsed(_spentTask) != 0)
+			_failures++;
+		if(_scheduler.getReadyCount() != 0 || _scheduler.runRound())
+			_failures++;
+		return _failures;
+	}
+}
+
+int main()
+{
+	int _failed = 0;
+	for(Engine _engine : { Engine::STEPPING, Engine::IR, Engine::THREADED, Engine::TIERED })
+	{
+		SimConfig _config = {};
+		_config.engine = _engine;
+		_config.maxDataMemorySize = 30000;
+
+		const int _slicing = checkSlicing(&_config);
+		const int _waits = checkWaits(&_config);
+		const int _completion = checkCompletion(&_config);
+		printf("%-9s slicing: %d, waits: %d, completion: %d mismatched\n", engineToStr(_engine), _slicing, _waits, _completion);
+		_failed += _slicing + _waits + _completion;
+	}
+
+	return _failed == 0 ? 0 : 1;
+}
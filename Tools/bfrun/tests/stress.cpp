@@ -0,0 +1,231 @@
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bfbatch.h"
+#include "bfsim.h"
+
+/* Runs many machines at once on shared Programs, on every engine, and checks that each run
+* prints what a lone stepping machine prints for the same source and input. */
+
+
+
+using namespace p95::bf;
+
+namespace
+{
+	struct Case
+	{
+		const char* name;
+		const char* source;
+		const char* input;
+	};
+
+	const Case CASES[] = {
+		{ "hello", "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.", "" },
+		{ "reverse", ">,[>,]<[.<]", "stressed" },
+		{ "bytes", "+[.+]", "" },
+		{ "nested", "++++++[>++++++[>++++++[>+>++<<-]<-]<-]>>>.>.", "" },
+		{ "echo", ",----------[++++++++++.,----------]", "shared programs, separate machines\n" },
+		{ "scan", "+>+>+>+>>>+[<]>[>]<.<.>>[-]<<[->>+<<]>>.", "" },
+	};
+
+	const Engine ENGINES[] = { Engine::IR, Engine::THREADED, Engine::JIT, Engine::NATIVE, Engine::TIERED };
+
+	const int TAPE_SIZE = 30000;
+	const int ROUNDS = 20;
+
+	struct Shared
+	{
+		std::shared_ptr<const Program> program;
+		std::string input;
+		std::string expected;
+	};
+
+	/* What a single stepping machine prints, the reference for every other run */
+	std::string stepOutput(const Case& test)
+	{
+		SimConfig _config = {};
+		_config.engine = Engine::STEPPING;
+		_config.maxDataMemorySize = TAPE_SIZE;
+
+		BF_Machine _machine;
+		_machine.init(&_config);
+		_machine.parseSource(test.source);
+		_machine.writeToStdInBuffer(test.input);
+		_machine.closeStdIn();
+		_machine.setState(MachineState::RUNNING);
+
+		MemorySink _sink;
+		_machine.setOutputSink(&_sink);
+		_machine.runUntilHalt();
+		return _sink.getData();
+	}
+
+	/* One thread: a single machine, reloaded with every shared program ROUNDS times */
+	void runThread(SimConfig* config, const std::vector<Shared>* shared, std::atomic<int>* failures)
+	{
+		BF_Machine _machine;
+		_machine.init(config);
+
+		for(int _round = 0; _round < ROUNDS; _round++)
+		{
+			for(const Shared& _entry : *shared)
+			{
+				_machine.reset();
+				_machine.loadProgram(_entry.program);
+				_machine.writeToStdInBuffer(_entry.input);
+				_machine.closeStdIn();
+				_machine.setState(MachineState::RUNNING);
+
+				MemorySink _sink;
+				_machine.setOutputSink(&_sink);
+				_machine.runUntilHalt();
+
+				if(_machine.getState() != MachineState::HALTED || _sink.getData() != _entry.expected)
+					(*failures)++;
+			}
+		}
+	}
+
+	/* Output of a halted run of a shared program, or the state it stopped in */
+	std::string runShared(const std::shared_ptr<const Program>& program, SimConfig* config)
+	{
+		BF_Machine _machine;
+		_machine.init(config);
+		_machine.loadProgram(program);
+		_machine.setState(MachineState::RUNNING);
+
+		MemorySink _sink;
+		_machine.setOutputSink(&_sink);
+		_machine.runUntilHalt();
+		return _machine.getState() == MachineState::HALTED ? _sink.getData() : "(" + std::string(stateToStr(_machine.getState())) + ")";
+	}
+
+	/* One Program run by machines that pick different threaded instantiations for it, each
+	* has to decode it against its own handlers. Returns the mismatches */
+	int checkVariants()
+	{
+		int _failures = 0;
+
+		/* Unchecked on a guarded tape of whole pages, checked on a plain one */
+		Dialect _error;
+		_error.edge = TapeEdge::ERROR;
+		const std::shared_ptr<const Program> _program = Program::build("++++++++[>++++++++<-]>+.", Engine::THREADED, _error);
+		for(bool _guarded : { true, false, true })
+		{
+			SimConfig _config = {};
+			_config.engine = Engine::THREADED;
+			_config.dialect = _error;
+			_config.maxDataMemorySize = 4096;
+			_config.guardedTape = _guarded;
+			if(runShared(_program, &_config) != "A")
+				_failures++;
+		}
+
+		/* TIERED counts back-edges in slices, the unbounded run tiers up on the same program */
+		const std::shared_ptr<const Program> _tiered = Program::build("++++[>+[+>+<]<-],.", Engine::TIERED);
+		SimConfig _config = {};
+		_config.engine = Engine::TIERED;
+		_config.maxDataMemorySize = TAPE_SIZE;
+		for(size_t _slice : { (size_t)10, (size_t)-1 })
+		{
+			BF_Machine _machine;
+			_machine.init(&_config);
+			_machine.loadProgram(_tiered);
+			_machine.setState(MachineState::RUNNING);
+			RunLimits _limits;
+			_limits.stopOnInput = true;
+			_limits.maxTicks = _slice;
+			while(_machine.runBatch(_limits).reason == StopReason::TICK_LIMIT)
+				;
+
+			_machine.writeToStdInBuffer("!");
+			_machine.closeStdIn();
+			MemorySink _sink;
+			_machine.setOutputSink(&_sink);
+			while(_machine.getState() == MachineState::RUNNING)
+				_machine.tick();
+			_machine.flushStdOut();
+			if(_sink.getData() != "!")
+				_failures++;
+		}
+
+		/* A machine whose tier-up fails runs the same program uncounted. A failing JIT can't be
+		* staged here, so decode against two stand-in tables in that order */
+		const void* _counting[(int)OpCode::SCAN + 1];
+		const void* _plain[(int)OpCode::SCAN + 1];
+		for(int i = 0; i <= (int)OpCode::SCAN; i++)
+		{
+			_counting[i] = &_counting[i];
+			_plain[i] = &_plain[i];
+		}
+		const std::vector<Op>& _ops = _tiered->getOps();
+		for(const void* const* _table : { (const void* const*)_counting, (const void* const*)_plain })
+		{
+			const void* const* _code = _tiered->getThreadedCode(_table, _table);
+			for(size_t i = 0; i < _ops.size(); i++)
+				if(_code[i] != _table[(int)_ops[i].code])
+					_failures++;
+			if(_code[_ops.size()] != _table)
+				_failures++;
+		}
+		return _failures;
+	}
+}
+
+int main()
+{
+	unsigned int _threads = std::thread::hardware_concurrency();
+	if(_threads < 4)
+		_threads = 4;
+
+	SimConfig _config = {};
+	_config.engine = Engine::THREADED;
+	_config.maxDataMemorySize = TAPE_SIZE;
+
+	int _failed = 0;
+	for(Engine _engine : ENGINES)
+	{
+		/* Every thread runs the same Program objects, built once */
+		std::vector<Shared> _shared;
+		for(const Case& _case : CASES)
+			_shared.push_back({ Program::build(_case.source, _engine), _case.input, stepOutput(_case) });
+
+		std::atomic<int> _failures(0);
+		std::vector<std::thread> _pool;
+		for(unsigned int i = 0; i < _threads; i++)
+			_pool.emplace_back(runThread, &_config, &_shared, &_failures);
+		for(std::thread& _thread : _pool)
+			_thread.join();
+
+		/* The batch runner deals the same jobs out with work stealing */
+		BatchRunner _runner(TAPE_SIZE, _threads);
+		for(int _round = 0; _round < ROUNDS; _round++)
+		{
+			for(const Shared& _entry : _shared)
+				_runner.submit({ _entry.program, std::make_shared<const std::string>(_entry.input), RunLimits() });
+		}
+		const std::vector<BatchResult> _results = _runner.run();
+		for(size_t i = 0; i < _results.size(); i++)
+		{
+			if(_results[i].result.reason != StopReason::HALTED || _results[i].output != _shared[i % _shared.size()].expected)
+				_failures++;
+		}
+
+		printf("%-9s %u threads x %d rounds x %zu programs: %d mismatched\n", engineToStr(_engine), _threads, ROUNDS, _shared.size(), _failures.load());
+		if(_failures.load() > 0)
+			_failed++;
+	}
+
+	const int _variantFailures = checkVariants();
+	printf("Shared across threaded variants: %d mismatched\n", _variantFailures);
+	if(_variantFailures > 0)
+		_failed++;
+
+	return _failed == 0 ? 0 : 1;
+}